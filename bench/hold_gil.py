@@ -0,0 +1,110 @@
+# -*- coding: utf-8 -*-
+
+
+"""Compares Loop.hold_gil to the default mode, with one and many threads.
+
+    python bench/hold_gil.py [--threads N] [--events N] [--runs N]
+
+Two workloads are measured:
+- "idle": an Idle watcher, one Python callback per loop iteration, no poll.
+- "pipe": a ping-pong through a pipe, one poll and one callback per event.
+
+Each of them is run with the loop thread alone and with N other Python
+threads spinning (they compete with the loop for the GIL).
+"""
+
+
+import argparse
+import os
+import threading
+import time
+
+from mood.event import EV_READ, Idle, Io, Loop
+
+
+def idle(loop, events):
+    count = 0
+
+    def callback(watcher, revents):
+        nonlocal count
+        count += 1
+        if count >= events:
+            loop.stop()
+
+    watcher = Idle(loop, callback)
+    watcher.start()
+    return lambda: watcher.stop()
+
+
+def pipe(loop, events):
+    rfd, wfd = os.pipe()
+    count = 0
+
+    def callback(watcher, revents):
+        nonlocal count
+        os.read(rfd, 1)
+        count += 1
+        if count >= events:
+            loop.stop()
+        else:
+            os.write(wfd, b"x")
+
+    watcher = Io(loop, rfd, EV_READ, callback)
+    watcher.start()
+    os.write(wfd, b"x")
+
+    def close():
+        watcher.stop()
+        os.close(rfd)
+        os.close(wfd)
+
+    return close
+
+
+def run(workload, hold_gil, threads, events):
+    loop = Loop()
+    loop.hold_gil = hold_gil
+    close = workload(loop, events)
+    running = True
+
+    def spin():
+        while running:
+            pass
+
+    spinners = [threading.Thread(target=spin) for _ in range(threads)]
+    for spinner in spinners:
+        spinner.start()
+    try:
+        start = time.perf_counter()
+        loop.start()
+        elapsed = time.perf_counter() - start
+    finally:
+        running = False
+        for spinner in spinners:
+            spinner.join()
+        close()
+    return events / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threads", type=int, default=4)
+    parser.add_argument("--events", type=int, default=100000)
+    parser.add_argument("--runs", type=int, default=5)
+    args = parser.parse_args()
+    for workload in (idle, pipe):
+        for threads in (0, args.threads):
+            for hold_gil in (False, True):
+                # best of runs
+                rate = max(
+                    run(workload, hold_gil, threads, args.events)
+                    for _ in range(args.runs)
+                )
+                print(
+                    f"{workload.__name__:>4}: threads={threads} "
+                    f"hold_gil={hold_gil!s:<5} {rate:>10.0f} events/s"
+                )
+
+
+if __name__ == "__main__":
+    main()
@@ -71,6 +71,8 @@ setup(
     namespace_packages=["mood"],
     zip_safe=False,
 
+    headers=["src/capi.h"],
+
     ext_package="mood",
     ext_modules=[
         Extension(
@@ -90,10 +92,18 @@ setup(
                 "src/watchers/embed.c",
                 "src/watchers/fork.c",
                 "src/watchers/async.c",
+                "src/watchers/native.c",
+                "src/watchers/stream.c",
+                "src/watchers/tls.c",
+                "src/watchers/listener.c",
+                "src/watchers/connector.c",
+                "src/watchers/iomux.c",
+                "src/watchers/datagram.c",
+                "src/capi.c",
                 "src/event.c",
             ],
             define_macros=[PKG_VERSION],
-            libraries=[libev_name],
+            libraries=[libev_name, "ssl", "crypto"],
             include_dirs=["src"]
         )
     ],
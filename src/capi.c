@@ -0,0 +1,130 @@
+#include "watchers/watcher.h"
+#include "capi.h"
+
+
+/* helpers ------------------------------------------------------------------ */
+
+static const int __CAPI_types__ = (
+    EV_IO |
+    EV_TIMER |
+#if EV_PERIODIC_ENABLE
+    EV_PERIODIC |
+#endif
+#if EV_SIGNAL_ENABLE
+    EV_SIGNAL |
+#endif
+#if EV_CHILD_ENABLE
+    EV_CHILD |
+#endif
+#if EV_IDLE_ENABLE
+    EV_IDLE |
+#endif
+#if EV_PREPARE_ENABLE
+    EV_PREPARE |
+#endif
+#if EV_CHECK_ENABLE
+    EV_CHECK |
+#endif
+#if EV_EMBED_ENABLE
+    EV_EMBED |
+#endif
+#if EV_FORK_ENABLE
+    EV_FORK |
+#endif
+#if EV_ASYNC_ENABLE
+    EV_ASYNC |
+#endif
+    0
+);
+
+
+static ev_loop *
+__CAPI_check__(PyObject *loop, int ev_type)
+{
+    // exactly one of the supported types
+    if (!(ev_type & __CAPI_types__) || (ev_type & (ev_type - 1))) {
+        PyErr_Format(PyExc_ValueError, "unsupported watcher type: %d", ev_type);
+        return NULL;
+    }
+    if (!PyObject_TypeCheck(loop, &Loop_Type)) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "expected a mood.event.Loop, got: %.200s",
+            Py_TYPE(loop)->tp_name
+        );
+        return NULL;
+    }
+    return ((Loop *)loop)->loop;
+}
+
+
+/* C API -------------------------------------------------------------------- */
+
+static ev_loop *
+__CAPI_Loop_AsEvLoop__(PyObject *loop)
+{
+    return __CAPI_check__(loop, EV_IO);
+}
+
+
+static int
+__CAPI_Watcher_Start__(PyObject *loop, ev_watcher *watcher, int ev_type)
+{
+    ev_loop *_loop_ = NULL;
+
+    if (!(_loop_ = __CAPI_check__(loop, ev_type))) {
+        return -1;
+    }
+    __ev_watcher_start__(_loop_, watcher, ev_type);
+    return 0;
+}
+
+
+static int
+__CAPI_Watcher_Stop__(PyObject *loop, ev_watcher *watcher, int ev_type)
+{
+    ev_loop *_loop_ = NULL;
+
+    if (!(_loop_ = __CAPI_check__(loop, ev_type))) {
+        return -1;
+    }
+    __ev_watcher_stop__(_loop_, watcher, ev_type);
+    return 0;
+}
+
+
+#if EV_ASYNC_ENABLE
+static void
+__CAPI_Async_Send__(PyObject *async)
+{
+    Watcher *self = (Watcher *)async;
+
+    ev_async_send(self->loop->loop, ((ev_async *)self->watcher));
+}
+#endif
+
+
+static MoodEvent_CAPI __CAPI__ = {
+    .version = MoodEvent_CAPI_VERSION,
+    .Loop_Type = &Loop_Type,
+    .Io_Type = &Io_Type,
+    .Timer_Type = &Timer_Type,
+#if EV_ASYNC_ENABLE
+    .Async_Type = &Async_Type,
+#endif
+    .Loop_AsEvLoop = __CAPI_Loop_AsEvLoop__,
+    .Watcher_Start = __CAPI_Watcher_Start__,
+    .Watcher_Stop = __CAPI_Watcher_Stop__,
+#if EV_ASYNC_ENABLE
+    .Async_Send = __CAPI_Async_Send__,
+#endif
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyObject *
+CAPI_new(void)
+{
+    return PyCapsule_New(&__CAPI__, MoodEvent_CAPI_NAME, NULL);
+}
@@ -0,0 +1,111 @@
+#ifndef Py_MOOD_EVENT_CAPI_H
+#define Py_MOOD_EVENT_CAPI_H
+
+
+/*
+   mood.event C API
+
+   Usage (from another extension module):
+
+       static MoodEvent_CAPI *MoodEvent = NULL;
+
+       // in the module init function
+       if (!(MoodEvent = MoodEvent_Import(MoodEvent_CAPI_VERSION))) {
+           return NULL;
+       }
+
+   Members are only ever appended to MoodEvent_CAPI (bumping
+   MoodEvent_CAPI_VERSION), a module built against an older version keeps
+   working with a newer mood.event.
+*/
+
+
+#include "Python.h"
+
+#include <ev.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+#define MoodEvent_CAPI_NAME "mood.event._C_API"
+#define MoodEvent_CAPI_VERSION 1
+
+
+typedef struct {
+    int version;
+
+    /* types */
+    PyTypeObject *Loop_Type;
+    PyTypeObject *Io_Type;
+    PyTypeObject *Timer_Type;
+    PyTypeObject *Async_Type;
+
+    /* the following require the GIL */
+
+    // returns the libev loop of a Loop (NULL and TypeError if not a Loop)
+    struct ev_loop *(*Loop_AsEvLoop)(PyObject *loop);
+
+    // start/stop a native libev watcher (initialized with ev_TYPE_init) on a
+    // Loop, its callback is called directly by libev (with the GIL held) and
+    // never enters Python. The caller must keep a reference to the Loop for as
+    // long as the watcher is active. Return -1 with an exception set on error.
+    int (*Watcher_Start)(PyObject *loop, ev_watcher *watcher, int ev_type);
+    int (*Watcher_Stop)(PyObject *loop, ev_watcher *watcher, int ev_type);
+
+    /* the following do not require the GIL */
+
+    // ev_async_send on an Async (the caller must keep a reference to it)
+    void (*Async_Send)(PyObject *async);
+} MoodEvent_CAPI;
+
+
+/*
+   NativeIo handlers
+
+   A handler is called (without the GIL) each time its NativeIo watcher gets
+   an event, with the watcher's fd, target and revents. It must add the number
+   of bytes it processed to *bytes and return 0 to keep the watcher going, or
+   -1 to stop it (with errno set, or 0 for a normal end, e.g. EOF).
+   Handlers are passed to NativeIo in a capsule named MoodEvent_NativeHandler_NAME.
+*/
+
+#define MoodEvent_NativeHandler_NAME "mood.event.NativeHandler"
+
+typedef int (*MoodEvent_NativeHandler)(
+    int fd, int target, int revents, Py_ssize_t *bytes
+);
+
+
+static inline MoodEvent_CAPI *
+MoodEvent_Import(int version)
+{
+    MoodEvent_CAPI *api = NULL;
+
+    if (
+        (api = (MoodEvent_CAPI *)PyCapsule_Import(MoodEvent_CAPI_NAME, 0)) &&
+        (api->version < version)
+    ) {
+        PyErr_Format(
+            PyExc_ImportError,
+            "mood.event C API version %d required, found version %d",
+            version, api->version
+        );
+        api = NULL;
+    }
+    return api;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+}
+#endif
+
+
+#endif // !Py_MOOD_EVENT_CAPI_H
@@ -60,6 +60,7 @@ _Py_Fatal_Context(PyObject *context)
 void
 ev_loop_stop(ev_loop *loop)
 {
+    ((Loop *)ev_userdata(loop))->stopped = 1;
     ev_break(loop, EVBREAK_ALL);
 }
 
@@ -79,6 +80,38 @@ ev_loop_warn(ev_loop *loop, PyObject *context)
 }
 
 
+int
+ev_loop_defer(ev_loop *loop, PyObject *watcher, PyObject *context)
+{
+    Loop *self = ev_userdata(loop);
+    PyObject *exc_type, *exc_value, *exc_traceback, *item = NULL;
+
+    if (
+        !self->max_errors ||
+        _Py_Fatal_Context(context) ||
+        !PyErr_ExceptionMatches(PyExc_Exception)
+    ) {
+        return 0;
+    }
+    PyErr_Fetch(&exc_type, &exc_value, &exc_traceback);
+    PyErr_NormalizeException(&exc_type, &exc_value, &exc_traceback);
+    if (exc_traceback) {
+        PyException_SetTraceback(exc_value, exc_traceback);
+    }
+    if (PyList_GET_SIZE(self->errors) >= self->max_errors) {
+        self->errors_dropped++;
+    }
+    else if ((item = PyTuple_Pack(2, watcher, exc_value))) {
+        PyList_Append(self->errors, item);
+        Py_DECREF(item);
+    }
+    Py_XDECREF(exc_type);
+    Py_XDECREF(exc_value);
+    Py_XDECREF(exc_traceback);
+    return 1;
+}
+
+
 /* --------------------------------------------------------------------------
     module
    -------------------------------------------------------------------------- */
@@ -357,6 +390,39 @@ static PyModuleDef event_def = {
 };
 
 
+/* module C API */
+static int
+__module_add_capi__(PyObject *module)
+{
+    PyObject *capi = NULL;
+    int result = -1;
+
+    if ((capi = CAPI_new())) {
+        result = PyModule_AddObjectRef(module, "_C_API", capi);
+        Py_DECREF(capi);
+    }
+    return result;
+}
+
+
+/* callback return values */
+static int
+__module_add_callback_results__(PyObject *module)
+{
+    CallbackResult *result = NULL;
+
+    if (PyType_Ready(&CallbackResult_Type)) {
+        return -1;
+    }
+    for (result = CallbackResults; result->name; result++) {
+        if (PyModule_AddObjectRef(module, result->name, (PyObject *)result)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
 /* module initialization */
 static inline int
 __module_init__(PyObject *module)
@@ -387,6 +453,7 @@ __module_init__(PyObject *module)
         _PyModule_AddIntMacro(module, EVRUN_ONCE) ||
         _PyModule_AddIntMacro(module, EVBREAK_ONE) ||
         _PyModule_AddIntMacro(module, EVBREAK_ALL) ||
+        __module_add_callback_results__(module) ||
         // Watcher
         PyType_Ready(&Watcher_Type) ||
         _PyModule_AddIntMacro(module, EV_MINPRI) ||
@@ -446,11 +513,39 @@ __module_init__(PyObject *module)
 #if EV_ASYNC_ENABLE
         // Async
         _PyModule_AddTypeWithBase(module, &Async_Type, &Watcher_Type) ||
+        // AsyncQueue
+        _PyModule_AddTypeWithBase(module, &AsyncQueue_Type, &Async_Type) ||
         _PyModule_AddIntMacro(module, EV_ASYNC) ||
 #endif
+        // NativeIo
+        _PyModule_AddTypeWithBase(module, &NativeIo_Type, &Io_Type) ||
+        // FileSender
+        _PyModule_AddTypeWithBase(module, &FileSender_Type, &NativeIo_Type) ||
+        // Splice
+        _PyModule_AddTypeWithBase(module, &Splice_Type, &NativeIo_Type) ||
+        // Stream
+        _PyModule_AddTypeWithBase(module, &Stream_Type, &Io_Type) ||
+        // Broadcast
+        PyModule_AddType(module, &Broadcast_Type) ||
+        // TLSContext
+        PyModule_AddType(module, &TLSContext_Type) ||
+        // TLSStream
+        _PyModule_AddTypeWithBase(module, &TLSStream_Type, &Stream_Type) ||
+        // Listener
+        _PyModule_AddTypeWithBase(module, &Listener_Type, &Io_Type) ||
+        // Connector
+        _PyModule_AddTypeWithBase(module, &Connector_Type, &Watcher_Type) ||
+#if EV_ASYNC_ENABLE
+        // IoMux
+        _PyModule_AddTypeWithBase(module, &IoMux_Type, &Watcher_Type) ||
+#endif
+        // Datagram
+        _PyModule_AddTypeWithBase(module, &Datagram_Type, &Io_Type) ||
         // additional events
         _PyModule_AddIntMacro(module, EV_CUSTOM) ||
         _PyModule_AddIntMacro(module, EV_ERROR) ||
+        // C API
+        __module_add_capi__(module) ||
         // version
         PyModule_AddStringConstant(module, "__version__", PKG_VERSION)
     ) {
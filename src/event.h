@@ -7,6 +7,9 @@
 
 #include "helpers/helpers.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,6 +21,17 @@ extern "C" {
 #define EV_COMPAT3 0
 #include <ev.h>
 
+#ifndef EV_NUMPRI
+#define EV_NUMPRI (EV_MAXPRI - EV_MINPRI + 1)
+#endif
+
+/* callback return values */
+#define EVCB_KEEP 0
+#define EVCB_STOP -1
+#define EVCB_READ EV_READ
+#define EVCB_WRITE EV_WRITE
+#define EVCB_READ_WRITE (EV_READ | EV_WRITE)
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -63,22 +77,136 @@ extern _Py_Identifier PyId___event_fatal__;
 
 void ev_loop_stop(ev_loop *);
 void ev_loop_warn(ev_loop *, PyObject *);
+int ev_loop_defer(ev_loop *, PyObject *, PyObject *);
+
+
+/* Mailbox, a lock-free multi-producer single-consumer queue */
+typedef struct __Message__ {
+    struct __Message__ *next;
+    PyObject *object;
+    PyObject *name;
+    PyObject *args;
+} Message;
+
+typedef struct {
+    _Atomic(Message *) head;
+    Message *first;
+    Message *last;
+} Mailbox;
+
+
+Message *Message_new(PyObject *, PyObject *, PyObject *);
+void Message_free(Message *);
+PyObject *Message_apply(Message *);
+
+void Mailbox_init(Mailbox *);
+int Mailbox_post(Mailbox *, Message *);
+void Mailbox_collect(Mailbox *);
+Message *Mailbox_pop(Mailbox *);
+void Mailbox_restore(Mailbox *, Message *, Message *);
+int Mailbox_pending(Mailbox *);
+int Mailbox_traverse(Mailbox *, visitproc, void *);
+void Mailbox_clear(Mailbox *);
 
 
 /* Loop */
+typedef struct {
+    PyObject *watcher;
+    int priority;
+    int effective;
+    unsigned long seq;
+    unsigned int iteration;
+    double stamp;
+    double deadline;
+} Pending;
+
+typedef struct {
+    unsigned long count;
+    double total;
+    double max;
+} Waits;
+
+typedef struct {
+    PyObject *callback;
+    PyObject *args;
+} Call;
+
 typedef struct {
     PyObject_HEAD
     ev_loop *loop;
     PyObject *callback;
     PyObject *data;
+    PyObject *batch;
+    PyObject *errors;
+    Py_ssize_t max_errors;
+    unsigned long errors_dropped;
     double io_ival;
     double timeout_ival;
+    ev_idle *idle;
+    ev_prepare *prepare;
+    ev_check *check;
+    Pending *queue;
+    Py_ssize_t queue_len;
+    Py_ssize_t queue_size;
+    unsigned long queue_seq;
+    int backlog;
+    int collecting;
+    int dispatching;
+    Py_ssize_t max_events;
+    double max_time;
+    Py_ssize_t aging_ival;
+    double aging_time;
+    int edf;
+    Waits waits[EV_NUMPRI];
+    double adaptive_min;
+    double adaptive_max;
+    double poll_start;
+    long busy_poll;
+    int busy_poll_sockets;
+    unsigned long spin_hits;
+    unsigned long spin_misses;
+    int spinning;
+    int spun;
+    unsigned int checks;
+    unsigned int idles;
+    int polled;
+    int stopped;
+    int hold_gil;
+    PyThreadState *tstate;
+    ev_prepare *soon;
+    Call *calls;
+    Py_ssize_t calls_head;
+    Py_ssize_t calls_len;
+    Py_ssize_t calls_size;
+    Py_ssize_t max_calls;
+    ev_async *async;
+    Mailbox mailbox;
+    pthread_mutex_t natives_lock;
+    ev_watcher **natives;
+    Py_ssize_t natives_len;
+    Py_ssize_t natives_size;
 } Loop;
 
 extern PyTypeObject Loop_Type;
 
 
 PyObject *Loop_new(PyTypeObject *, PyObject *, PyObject *, int);
+int Loop_post(Loop *, PyObject *, PyObject *, PyObject *);
+
+
+/* C API (capi.c) */
+PyObject *CAPI_new(void);
+
+
+/* callback return values (watcher.c) */
+typedef struct {
+    PyObject_HEAD
+    const char *name;
+    int code;
+} CallbackResult;
+
+extern PyTypeObject CallbackResult_Type;
+extern CallbackResult CallbackResults[];
 
 
 /* watcher types */
@@ -114,7 +242,21 @@ extern PyTypeObject Fork_Type;
 #endif
 #if EV_ASYNC_ENABLE
 extern PyTypeObject Async_Type;
+extern PyTypeObject AsyncQueue_Type;
+#endif
+extern PyTypeObject NativeIo_Type;
+extern PyTypeObject FileSender_Type;
+extern PyTypeObject Splice_Type;
+extern PyTypeObject Stream_Type;
+extern PyTypeObject Broadcast_Type;
+extern PyTypeObject TLSContext_Type;
+extern PyTypeObject TLSStream_Type;
+extern PyTypeObject Listener_Type;
+extern PyTypeObject Connector_Type;
+#if EV_ASYNC_ENABLE
+extern PyTypeObject IoMux_Type;
 #endif
+extern PyTypeObject Datagram_Type;
 
 
 /* -------------------------------------------------------------------------- */
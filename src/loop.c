@@ -1,38 +1,1081 @@
-#include "event.h"
+#include "watchers/watcher.h"
+
+
+/* pending queue ------------------------------------------------------------ */
+
+typedef struct {
+    Py_ssize_t max_events;
+    double max_time;
+    int min_priority;
+    Py_ssize_t events;
+    double start;
+} Budget;
+
+
+static int
+__Budget_exhausted__(Budget *budget)
+{
+    return (
+        (budget->max_events && (budget->events >= budget->max_events)) ||
+        (budget->max_time && ((ev_time() - budget->start) >= budget->max_time))
+    );
+}
+
+
+int
+Loop_enqueue(Loop *self, Watcher *watcher, int revents)
+{
+    Pending *queue = self->queue;
+    Py_ssize_t size = self->queue_size;
+
+    if (watcher->queued) {
+        watcher->queued |= revents;
+        return 0;
+    }
+    if (self->queue_len == size) {
+        size = size ? (size * 2) : 64;
+        if (!PyMem_Resize(queue, Pending, size)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->queue = queue;
+        self->queue_size = size;
+    }
+    queue = &self->queue[self->queue_len++];
+    queue->watcher = Py_NewRef(watcher);
+    queue->priority = Py_MAX(
+        EV_MINPRI, Py_MIN(ev_priority(watcher->watcher), EV_MAXPRI)
+    );
+    queue->effective = queue->priority;
+    queue->seq = self->queue_seq++;
+    queue->iteration = ev_iteration(self->loop);
+    // same clock as __Loop_age__()/__Loop_wait__(), ev_now() is only updated
+    // once per iteration
+    queue->stamp = ev_time();
+    watcher->queued = revents;
+    return 0;
+}
+
+
+static int
+__Pending_compare__(const void *a, const void *b)
+{
+    const Pending *x = a, *y = b;
+
+    if (x->effective != y->effective) {
+        return (x->effective < y->effective) ? 1 : -1;
+    }
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+
+static int
+__Pending_compare_deadlines__(const void *a, const void *b)
+{
+    const Pending *x = a, *y = b;
+
+    if (x->deadline != y->deadline) {
+        if (!x->deadline || !y->deadline) {
+            // watchers without a deadline come last
+            return x->deadline ? -1 : 1;
+        }
+        return (x->deadline > y->deadline) ? 1 : -1;
+    }
+    return __Pending_compare__(a, b);
+}
+
+
+static Py_ssize_t
+__Loop_queued__(Loop *self)
+{
+    Py_ssize_t i, result = 0;
+
+    for (i = 0; i < self->queue_len; i++) {
+        if (((Watcher *)self->queue[i].watcher)->queued) {
+            result++;
+        }
+    }
+    return result;
+}
+
+
+static void
+__Loop_age__(Loop *self)
+{
+    unsigned int iteration = ev_iteration(self->loop);
+    double now = ev_time();
+    Pending *pending = NULL;
+    Py_ssize_t i, boost;
+
+    for (i = 0; i < self->queue_len; i++) {
+        pending = &self->queue[i];
+        boost = 0;
+        if (self->aging_ival) {
+            boost = (iteration - pending->iteration) / self->aging_ival;
+        }
+        if (self->aging_time) {
+            boost = Py_MAX(
+                boost, (Py_ssize_t)((now - pending->stamp) / self->aging_time)
+            );
+        }
+        pending->effective = (int)Py_MIN(pending->priority + boost, EV_MAXPRI);
+    }
+}
+
+
+static void
+__Loop_wait__(Loop *self, Pending *pending)
+{
+    Waits *waits = &self->waits[pending->priority - EV_MINPRI];
+    double wait = Py_MAX(ev_time() - pending->stamp, 0.0);
+
+    waits->count++;
+    waits->total += wait;
+    if (wait > waits->max) {
+        waits->max = wait;
+    }
+}
+
+
+static void
+__Loop_clear_queue__(Loop *self)
+{
+    Py_ssize_t i, len = self->queue_len;
+    Watcher *watcher = NULL;
+
+    self->queue_len = 0;
+    self->backlog = 0;
+    for (i = 0; i < len; i++) {
+        watcher = (Watcher *)self->queue[i].watcher;
+        watcher->queued = 0;
+        Py_DECREF(watcher);
+    }
+}
+
+
+static void
+__Loop_idle__(Loop *self)
+{
+#if EV_IDLE_ENABLE
+    // an active idle watcher keeps the next poll from blocking, watchers left
+    // below min_priority do not, only another invoke() can run them
+    if (self->backlog || self->calls_len) {
+        ev_idle_start(self->loop, self->idle);
+    }
+    else {
+        ev_idle_stop(self->loop, self->idle);
+    }
+#endif
+}
+
+
+static int
+__Loop_batch_append__(PyObject *batch, Watcher *watcher, int revents)
+{
+    PyObject *item = NULL, *_revents_ = NULL;
+    int result = -1;
+
+    if (
+        (_revents_ = PyLong_FromLong(revents)) &&
+        (item = PyTuple_Pack(2, watcher, _revents_))
+    ) {
+        result = PyList_Append(batch, item);
+    }
+    Py_XDECREF(item);
+    Py_XDECREF(_revents_);
+    return result;
+}
+
+
+static void
+__Loop_invoke_batch__(Loop *self, PyObject *callback, PyObject *batch)
+{
+    PyObject *result = NULL;
+
+    if (!_Py_Invoke_Verify(callback, "loop batch callback")) {
+        if ((result = _Py_Invoke_Callback(callback, self, batch, NULL))) {
+            Py_DECREF(result);
+        }
+        else if (!ev_loop_defer(self->loop, Py_None, callback)) {
+            ev_loop_warn(self->loop, callback);
+        }
+    }
+    if (PyErr_Occurred() || PyErr_CheckSignals()) {
+        ev_loop_stop(self->loop);
+    }
+}
+
+
+// puts back in the queue the watchers of a batch that could not be invoked
+static void
+__Loop_requeue_batch__(Loop *self, PyObject *batch, Pending *batched)
+{
+    Py_ssize_t i, len = PyList_GET_SIZE(batch);
+    PyObject *item = NULL;
+
+    // the queue has room, they were taken from it
+    for (i = 0; i < len; i++) {
+        item = PyList_GET_ITEM(batch, i);
+        ((Watcher *)batched[i].watcher)->queued =
+            (int)PyLong_AS_LONG(PyTuple_GET_ITEM(item, 1));
+        self->queue[self->queue_len++] = batched[i];
+    }
+}
+
+
+static int
+__Loop_dispatch__(Loop *self, Budget *budget)
+{
+    Pending *queue = self->queue, *batched = NULL;
+    Py_ssize_t i, j, len = self->queue_len;
+    Watcher *watcher = NULL;
+    PyObject *callback = NULL, *batch = NULL;
+    int revents = 0, exhausted = 0, backlog = 0;
+
+    if (self->batch != Py_None) {
+        if (!(batched = PyMem_New(Pending, len))) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        if (!(batch = PyList_New(0))) {
+            PyMem_Free(batched);
+            return -1;
+        }
+        callback = Py_NewRef(self->batch);
+    }
+
+    if (self->aging_ival || self->aging_time) {
+        __Loop_age__(self);
+    }
+    if (self->edf) {
+        for (i = 0; i < len; i++) {
+            queue[i].deadline = ((Watcher *)queue[i].watcher)->deadline;
+        }
+        qsort(queue, len, sizeof(Pending), __Pending_compare_deadlines__);
+    }
+    else {
+        qsort(queue, len, sizeof(Pending), __Pending_compare__);
+    }
+    self->dispatching = 1;
+    for (i = 0, j = 0; i < len; i++) {
+        watcher = (Watcher *)queue[i].watcher;
+        if (!watcher->queued) {
+            // stopped or cleared since it was queued
+            Py_DECREF(watcher);
+        }
+        else if (queue[i].effective < budget->min_priority) {
+            queue[j++] = queue[i];
+        }
+        else if (exhausted || (exhausted = __Budget_exhausted__(budget))) {
+            queue[j++] = queue[i];
+            backlog = 1;
+        }
+        else {
+            __Loop_wait__(self, &queue[i]);
+            revents = watcher->queued;
+            watcher->queued = 0;
+            if (
+                batch &&
+                (watcher->callback != Py_None) &&
+                // watchers with a C handler (Stream, Listener, etc.) must run
+                (ev_cb(watcher->watcher) == __ev_watcher_invoke__)
+            ) {
+                if (__Loop_batch_append__(batch, watcher, revents)) {
+                    // keep it queued, it will be dispatched next time
+                    watcher->queued = revents;
+                    queue[j++] = queue[i];
+                    exhausted = backlog = 1;
+                    continue;
+                }
+                // keep our reference until the batch is invoked
+                batched[PyList_GET_SIZE(batch) - 1] = queue[i];
+                budget->events++;
+                continue;
+            }
+            ev_invoke(self->loop, watcher->watcher, revents);
+            budget->events++;
+            Py_DECREF(watcher);
+            exhausted = (PyErr_Occurred() != NULL);
+        }
+    }
+    self->queue_len = j;
+    if (batch) {
+        if (PyErr_Occurred()) {
+            // do not lose their events
+            __Loop_requeue_batch__(self, batch, batched);
+            backlog = 1;
+        }
+        else if ((len = PyList_GET_SIZE(batch))) {
+            __Loop_invoke_batch__(self, callback, batch);
+            for (i = 0; i < len; i++) {
+                Py_DECREF(batched[i].watcher);
+            }
+        }
+        Py_DECREF(batch);
+        Py_DECREF(callback);
+        PyMem_Free(batched);
+    }
+    self->backlog = backlog;
+    self->dispatching = 0;
+    return PyErr_Occurred() ? -1 : 0;
+}
+
+
+static int
+__Loop_invoke__(Loop *self, Budget *budget)
+{
+    int result = 0;
+
+    if (
+        self->dispatching ||
+        (
+            !self->queue_len &&
+            !budget->max_events &&
+            !budget->max_time &&
+            (budget->min_priority <= EV_MINPRI) &&
+            !self->aging_ival &&
+            !self->aging_time &&
+            !self->edf &&
+            (self->batch == Py_None)
+        )
+    ) {
+        ev_invoke_pending(self->loop);
+        return PyErr_Occurred() ? -1 : 0;
+    }
+    budget->events = 0;
+    budget->start = budget->max_time ? ev_time() : 0.0;
+    do {
+        self->collecting = 1;
+        ev_invoke_pending(self->loop);
+        self->collecting = 0;
+        if ((result = PyErr_Occurred() ? -1 : __Loop_dispatch__(self, budget))) {
+            break;
+        }
+    } while (ev_pending_count(self->loop) && !__Budget_exhausted__(budget));
+    __Loop_idle__(self);
+    return result;
+}
+
+
+/* call soon ---------------------------------------------------------------- */
+
+// calls is a ring buffer, its size is always a power of 2
+#define __Loop_call_at__(L, i) \
+    (&(L)->calls[((L)->calls_head + (i)) & ((L)->calls_size - 1)])
+
+
+static int
+__Loop_grow_calls__(Loop *self)
+{
+    Py_ssize_t i, size = self->calls_size ? (self->calls_size * 2) : 64;
+    Call *calls = NULL;
+
+    if (!(calls = PyMem_New(Call, size))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    for (i = 0; i < self->calls_len; i++) {
+        calls[i] = *__Loop_call_at__(self, i);
+    }
+    PyMem_Free(self->calls);
+    self->calls = calls;
+    self->calls_head = 0;
+    self->calls_size = size;
+    return 0;
+}
+
+
+static void
+__Loop_clear_calls__(Loop *self)
+{
+    Call *call = NULL;
+
+    while (self->calls_len) {
+        call = __Loop_call_at__(self, 0);
+        self->calls_head = (self->calls_head + 1) & (self->calls_size - 1);
+        self->calls_len--;
+        Py_DECREF(call->callback);
+        Py_DECREF(call->args);
+    }
+}
+
+
+#if EV_PREPARE_ENABLE
+static int
+__Loop_call_soon__(Loop *self, PyObject *callback, PyObject *args)
+{
+    Call *call = NULL;
+
+    if ((self->calls_len == self->calls_size) && __Loop_grow_calls__(self)) {
+        return -1;
+    }
+    call = __Loop_call_at__(self, self->calls_len++);
+    call->callback = Py_NewRef(callback);
+    call->args = Py_NewRef(args);
+    if (self->calls_len == 1) {
+        ev_prepare_start(self->loop, self->soon);
+        __Loop_idle__(self);
+    }
+    return 0;
+}
+
+
+static void
+__ev_loop_soon__(ev_loop *loop, ev_prepare *prepare, int revents)
+{
+    Loop *self = ev_userdata(loop);
+    // calls made while draining wait for the next iteration
+    Py_ssize_t count = self->calls_len;
+    PyObject *result = NULL;
+    Call call;
+
+    if (self->max_calls) {
+        count = Py_MIN(count, self->max_calls);
+    }
+    while (count-- && !PyErr_Occurred()) {
+        call = *__Loop_call_at__(self, 0);
+        self->calls_head = (self->calls_head + 1) & (self->calls_size - 1);
+        self->calls_len--;
+        if ((result = PyObject_Call(call.callback, call.args, NULL))) {
+            Py_DECREF(result);
+        }
+        else if (!ev_loop_defer(loop, Py_None, call.callback)) {
+            ev_loop_warn(loop, call.callback);
+        }
+        Py_DECREF(call.callback);
+        Py_DECREF(call.args);
+        if (!self->max_errors && PyErr_CheckSignals()) {
+            break;
+        }
+    }
+    if (!self->calls_len) {
+        ev_prepare_stop(loop, prepare);
+    }
+    __Loop_idle__(self);
+    if (PyErr_Occurred()) {
+        ev_loop_stop(loop);
+    }
+}
+#endif
+
+
+/* mailbox ------------------------------------------------------------------ */
+
+Message *
+Message_new(PyObject *object, PyObject *name, PyObject *args)
+{
+    Message *self = NULL;
+
+    // raw allocator, messages may be freed from another thread
+    if (!(self = PyMem_RawMalloc(sizeof(Message)))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    self->next = NULL;
+    self->object = Py_NewRef(object);
+    self->name = Py_XNewRef(name);
+    self->args = Py_XNewRef(args);
+    return self;
+}
+
+
+void
+Message_free(Message *self)
+{
+    Py_DECREF(self->object);
+    Py_XDECREF(self->name);
+    Py_XDECREF(self->args);
+    PyMem_RawFree(self);
+}
+
+
+PyObject *
+Message_apply(Message *self)
+{
+    if (self->name) {
+        return PyObject_CallMethodNoArgs(self->object, self->name);
+    }
+    return PyObject_Call(self->object, self->args, NULL);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+Mailbox_init(Mailbox *self)
+{
+    atomic_init(&self->head, NULL);
+    self->first = NULL;
+    self->last = NULL;
+}
+
+
+// any thread, returns 1 if the mailbox was empty (the consumer must be woken up)
+int
+Mailbox_post(Mailbox *self, Message *message)
+{
+    Message *head = atomic_load_explicit(&self->head, memory_order_relaxed);
+
+    do {
+        message->next = head;
+    } while (
+        !atomic_compare_exchange_weak_explicit(
+            &self->head, &head, message,
+            memory_order_release, memory_order_relaxed
+        )
+    );
+    return (head == NULL);
+}
+
+
+// consumer only
+void
+Mailbox_collect(Mailbox *self)
+{
+    Message *message = NULL, *next = NULL, *first = NULL, *last = NULL;
+
+    message = atomic_exchange_explicit(&self->head, NULL, memory_order_acquire);
+    // messages are posted in lifo order, restore fifo
+    for (last = message; message; message = next) {
+        next = message->next;
+        message->next = first;
+        first = message;
+    }
+    if (first) {
+        if (self->last) {
+            self->last->next = first;
+        }
+        else {
+            self->first = first;
+        }
+        self->last = last;
+    }
+}
+
+
+// consumer only, pops the messages collected so far
+Message *
+Mailbox_pop(Mailbox *self)
+{
+    Message *message = self->first;
+
+    if (message && !(self->first = message->next)) {
+        self->last = NULL;
+    }
+    return message;
+}
+
+
+// consumer only, puts back popped messages (first to last) in front
+void
+Mailbox_restore(Mailbox *self, Message *first, Message *last)
+{
+    if (!(last->next = self->first)) {
+        self->last = last;
+    }
+    self->first = first;
+}
+
+
+int
+Mailbox_pending(Mailbox *self)
+{
+    return (
+        self->first ||
+        atomic_load_explicit(&self->head, memory_order_relaxed)
+    );
+}
+
+
+int
+Mailbox_traverse(Mailbox *self, visitproc visit, void *arg)
+{
+    Message *message = NULL;
+
+    message = atomic_load_explicit(&self->head, memory_order_acquire);
+    for (; message; message = message->next) {
+        Py_VISIT(message->object);
+        Py_VISIT(message->args);
+    }
+    for (message = self->first; message; message = message->next) {
+        Py_VISIT(message->object);
+        Py_VISIT(message->args);
+    }
+    return 0;
+}
+
+
+void
+Mailbox_clear(Mailbox *self)
+{
+    Message *message = NULL;
+
+    Mailbox_collect(self);
+    while ((message = Mailbox_pop(self))) {
+        Message_free(message);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+#if EV_ASYNC_ENABLE
+static void
+__ev_loop_mailbox__(ev_loop *loop, ev_async *async, int revents)
+{
+    Loop *self = ev_userdata(loop);
+    PyObject *result = NULL, *watcher = NULL;
+    Message *message = NULL;
+
+    // messages posted from now on will wake us up again
+    Mailbox_collect(&self->mailbox);
+    while (!PyErr_Occurred() && (message = Mailbox_pop(&self->mailbox))) {
+        if ((result = Message_apply(message))) {
+            Py_DECREF(result);
+        }
+        else {
+            watcher = message->name ? message->object : Py_None;
+            if (!ev_loop_defer(loop, watcher, message->object)) {
+                ev_loop_warn(loop, message->object);
+            }
+        }
+        Message_free(message);
+    }
+    if (PyErr_Occurred()) {
+        ev_loop_stop(loop);
+    }
+}
+#endif
+
+
+int
+Loop_post(Loop *self, PyObject *object, PyObject *name, PyObject *args)
+{
+#if EV_ASYNC_ENABLE
+    Message *message = NULL;
+
+    if (!(message = Message_new(object, name, args))) {
+        return -1;
+    }
+    if (Mailbox_post(&self->mailbox, message)) {
+        ev_async_send(self->loop, self->async);
+    }
+    return 0;
+#else
+    PyErr_SetString(EventError, "libev was built without async support");
+    return -1;
+#endif
+}
+
+
+/* native watchers --------------------------------------------------------- */
+
+// natives is shared with the loop thread, that runs native watchers without
+// the GIL (and may take it while holding natives_lock, see NativeIo), it is
+// only accessed with natives_lock held, never taken while waiting for the GIL
+
+int
+Loop_add_native(Loop *self, ev_watcher *watcher)
+{
+    ev_watcher **natives = NULL;
+    Py_ssize_t size = 0;
+    int result = 0;
+
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&self->natives_lock);
+    if (self->natives_len == (size = self->natives_size)) {
+        size = size ? (size * 2) : 16;
+        if (
+            (natives = PyMem_RawRealloc(
+                self->natives, size * sizeof(ev_watcher *)
+            ))
+        ) {
+            self->natives = natives;
+            self->natives_size = size;
+        }
+        else {
+            result = -1;
+        }
+    }
+    if (!result) {
+        self->natives[self->natives_len++] = watcher;
+    }
+    pthread_mutex_unlock(&self->natives_lock);
+    Py_END_ALLOW_THREADS
+    if (result) {
+        PyErr_NoMemory();
+    }
+    return result;
+}
+
+
+// may be called without the GIL
+void
+Loop_remove_native(Loop *self, ev_watcher *watcher)
+{
+    PyThreadState *tstate = NULL;
+    Py_ssize_t i;
+
+    if (PyGILState_Check()) {
+        tstate = PyEval_SaveThread();
+    }
+    pthread_mutex_lock(&self->natives_lock);
+    for (i = 0; i < self->natives_len; i++) {
+        if (self->natives[i] == watcher) {
+            self->natives[i] = self->natives[--self->natives_len];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&self->natives_lock);
+    if (tstate) {
+        PyEval_RestoreThread(tstate);
+    }
+}
+
+
+// invokes the pending native watchers without the GIL, returns their number
+static unsigned int
+__Loop_invoke_natives__(Loop *self)
+{
+    PyThreadState *tstate = NULL;
+    ev_watcher *watcher = NULL;
+    unsigned int count = 0;
+    Py_ssize_t i;
+
+    pthread_mutex_lock(&self->natives_lock);
+    for (i = 0; i < self->natives_len; i++) {
+        count += ev_is_pending(self->natives[i]);
+    }
+    if (count) {
+        // with hold_gil we hold it (nobody holding natives_lock waits for it)
+        if (self->hold_gil) {
+            tstate = PyEval_SaveThread();
+        }
+        // backwards: a watcher removed by a handler is replaced by the last one
+        for (i = self->natives_len; i--; ) {
+            if (
+                (i < self->natives_len) &&
+                ev_is_pending((watcher = self->natives[i]))
+            ) {
+                // leaves a no-op in libev pending queue, counted in count
+                ev_invoke(
+                    self->loop, watcher, ev_clear_pending(self->loop, watcher)
+                );
+            }
+        }
+        if (tstate) {
+            PyEval_RestoreThread(tstate);
+        }
+    }
+    pthread_mutex_unlock(&self->natives_lock);
+    return count;
+}
 
 
 /* helpers ------------------------------------------------------------------ */
 
+#if EV_IDLE_ENABLE
+static void
+__ev_loop_idle__(ev_loop *loop, ev_idle *idle, int revents)
+{
+    // nothing to do
+}
+#endif
+
+
+static unsigned int
+__Loop_pending__(Loop *self)
+{
+    unsigned int count = ev_pending_count(self->loop);
+
+    // do not count our own internal watchers
+#if EV_IDLE_ENABLE
+    // pending when watchers are left queued, they are counted below
+    count -= ev_is_pending(self->idle);
+#endif
+#if EV_PREPARE_ENABLE && EV_CHECK_ENABLE
+    count -= ev_is_pending(self->prepare) + ev_is_pending(self->check);
+#endif
+    // watchers left below min_priority wait for another invoke()
+    return (count + (self->backlog ? self->queue_len : 0));
+}
+
+
+/* check (and idle) watchers are queued after every poll, they are not work */
+static unsigned int
+__Loop_work__(Loop *self, unsigned int pending, int polled)
+{
+    unsigned int idle = polled ? (self->checks + self->idles) : 0;
+
+    return (pending > idle) ? (pending - idle) : 0;
+}
+
+
+static void
+__ev_loop_release__(ev_loop *loop)
+{
+    Loop *self = ev_userdata(loop);
+
+    self->tstate = PyEval_SaveThread();
+}
+
+
+static void
+__ev_loop_acquire__(ev_loop *loop)
+{
+    Loop *self = ev_userdata(loop);
+
+    PyEval_RestoreThread(self->tstate);
+    self->tstate = NULL;
+}
+
+
+static void
+__ev_loop_invoke__(ev_loop *loop)
+{
+    Loop *self = ev_userdata(loop);
+    PyGILState_STATE gstate = PyGILState_UNLOCKED;
+    Budget budget = {self->max_events, self->max_time, EV_MINPRI};
+    unsigned int pending = 0;
+
+    if (self->spinning) {
+        // busy polling without the GIL, only take it if there is work to do
+        int polled = self->polled;
+
+        pending = __Loop_pending__(self);
+        self->polled = 0;
+        if (!pending) {
+            return;
+        }
+        // user check and idle watchers are pending after every poll, they are
+        // invoked but only io, timer, signal, async or queued watchers end the
+        // spin
+        if (__Loop_work__(self, pending, polled)) {
+            self->spun = 1;
+        }
+    }
+    // native watchers never enter Python, they are run first without the GIL
+    if (
+        (pending = __Loop_invoke_natives__(self)) &&
+        (pending == ev_pending_count(loop))
+    ) {
+        // nothing else to do, no need for the GIL
+        ev_invoke_pending(loop);
+        return;
+    }
+    // with hold_gil we already hold it (released only around the poll)
+    if (!self->hold_gil) {
+        gstate = PyGILState_Ensure();
+    }
+
+    if (!_Py_Invoke_Verify(self->callback, "loop callback")) {
+        if (self->callback != Py_None) {
+            Py_XDECREF(_Py_Invoke_Callback(self->callback, self, NULL));
+        }
+        else {
+            __Loop_invoke__(self, &budget);
+        }
+    }
+    if (PyErr_Occurred() || PyErr_CheckSignals()) {
+        ev_loop_stop(loop);
+    }
+    if (!self->hold_gil) {
+        PyGILState_Release(gstate);
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   Loop
+   -------------------------------------------------------------------------- */
+
+#define __Loop_set_interval__(L, t, i) \
+    do { \
+        ev_set_##t##_collect_interval((L)->loop, (i)); \
+        (L)->t##_ival = (i); \
+    } while (0)
+
+
+#define __Loop_start_internal__(L, t, w) \
+    do { \
+        if (!ev_is_active((w))) { \
+            ev_##t##_start((L)->loop, (w)); \
+            ev_unref((L)->loop); \
+        } \
+    } while (0)
+
+#define __Loop_stop_internal__(L, t, w) \
+    do { \
+        if (ev_is_active((w))) { \
+            ev_ref((L)->loop); \
+            ev_##t##_stop((L)->loop, (w)); \
+        } \
+    } while (0)
+
+
+static int
+__Loop_count_or_none__(PyObject *value, Py_ssize_t *result)
+{
+    Py_ssize_t count = 0;
+
+    if (value != Py_None) {
+        if (((count = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+            return -1;
+        }
+        if (count <= 0) {
+            PyErr_SetString(
+                PyExc_ValueError, "a positive int or None is required"
+            );
+            return -1;
+        }
+    }
+    *result = count;
+    return 0;
+}
+
+
+static int
+__Loop_time_or_none__(PyObject *value, double *result)
+{
+    double time = 0.0;
+
+    if (value != Py_None) {
+        if (((time = PyFloat_AsDouble(value)) == -1.0) && PyErr_Occurred()) {
+            return -1;
+        }
+        if (time <= 0.0) {
+            PyErr_SetString(
+                PyExc_ValueError, "a positive float or None is required"
+            );
+            return -1;
+        }
+    }
+    *result = time;
+    return 0;
+}
+
+
+#if EV_PREPARE_ENABLE && EV_CHECK_ENABLE
+static void
+__ev_loop_prepare__(ev_loop *loop, ev_prepare *prepare, int revents)
+{
+    Loop *self = ev_userdata(loop);
+
+    self->poll_start = ev_time();
+}
+
+
 static void
-__ev_loop_invoke__(ev_loop *loop)
+__ev_loop_check__(ev_loop *loop, ev_check *check, int revents)
 {
-    PyGILState_STATE gstate = PyGILState_Ensure();
     Loop *self = ev_userdata(loop);
+    double poll = ev_time() - self->poll_start, ival = self->io_ival;
+    // smallest non-zero interval used when ramping up from (or down to) min
+    double step = Py_MAX(self->adaptive_min, self->adaptive_max / 16);
 
-    if (!_Py_Invoke_Verify(self->callback, "loop callback")) {
-        if (self->callback != Py_None) {
-            Py_XDECREF(_Py_Invoke_Callback(self->callback, self, NULL));
-        }
-        else {
-            ev_invoke_pending(loop);
+    if (
+        (__Loop_work__(self, __Loop_pending__(self), 1) > 1) &&
+        (poll < ((2 * ival) + step))
+    ) {
+        // several events were already waiting: batch more
+        ival = ival ? Py_MIN(ival * 2, self->adaptive_max) : step;
+    }
+    else {
+        // light traffic (or we actually had to wait): favour latency
+        ival = ((ival / 2) < step) ? self->adaptive_min : (ival / 2);
+    }
+    if (ival != self->io_ival) {
+        __Loop_set_interval__(self, io, ival);
+        __Loop_set_interval__(self, timeout, ival);
+    }
+}
+
+
+static int
+__Loop_set_adaptive__(Loop *self, double min, double max)
+{
+    double ival = max ? min : self->adaptive_min;
+
+    if (!max && !self->adaptive_max) {
+        // was not adaptive, keep the intervals set by the user
+        return 0;
+    }
+    self->adaptive_min = min;
+    self->adaptive_max = max;
+    __Loop_set_interval__(self, io, ival);
+    __Loop_set_interval__(self, timeout, ival);
+    if (max) {
+        __Loop_start_internal__(self, prepare, self->prepare);
+        __Loop_start_internal__(self, check, self->check);
+    }
+    else {
+        __Loop_stop_internal__(self, prepare, self->prepare);
+        __Loop_stop_internal__(self, check, self->check);
+    }
+    return 0;
+}
+#endif
+
+
+// installed while spinning (never with hold_gil), notes that the backend
+// was polled, i.e. that check watchers are about to be pending
+static void
+__ev_loop_spin_release__(ev_loop *loop)
+{
+}
+
+
+static void
+__ev_loop_spin_acquire__(ev_loop *loop)
+{
+    ((Loop *)ev_userdata(loop))->polled = 1;
+}
+
+
+/* must be called without the GIL */
+static int
+__Loop_spin__(Loop *self)
+{
+    double deadline = ev_time() + (self->busy_poll * 1e-6);
+    int result = 1;
+
+    ev_set_loop_release_cb(
+        self->loop, __ev_loop_spin_release__, __ev_loop_spin_acquire__
+    );
+    self->spinning = 1;
+    self->spun = 0;
+    self->polled = 0;
+    while (!self->stopped && (ev_time() < deadline)) {
+        if (!(result = ev_run(self->loop, EVRUN_NOWAIT)) || self->spun) {
+            break;
         }
     }
-    if (PyErr_Occurred() || PyErr_CheckSignals()) {
-        ev_loop_stop(loop);
+    self->spinning = 0;
+    self->polled = 0;
+    ev_set_loop_release_cb(self->loop, NULL, NULL);
+    if (self->spun) {
+        self->spin_hits++;
     }
-    PyGILState_Release(gstate);
+    else if (result && !self->stopped) {
+        self->spin_misses++;
+        // nothing came up, block in the backend
+        result = ev_run(self->loop, EVRUN_ONCE);
+    }
+    return result;
 }
 
 
-/* --------------------------------------------------------------------------
-   Loop
-   -------------------------------------------------------------------------- */
+// recursive: a native watcher's callback may start or stop native watchers
+static void
+__Loop_init_natives_lock__(Loop *self)
+{
+    pthread_mutexattr_t attr;
 
-#define __Loop_set_interval__(L, t, i) \
-    do { \
-        ev_set_##t##_collect_interval((L)->loop, (i)); \
-        (L)->t##_ival = (i); \
-    } while (0)
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&self->natives_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
 
 
 static Loop *
@@ -44,8 +1087,55 @@ __Loop_alloc__(PyTypeObject *type)
         self->loop = NULL;
         self->callback = NULL;
         self->data = NULL;
+        self->batch = NULL;
+        self->errors = NULL;
+        self->max_errors = 0;
+        self->errors_dropped = 0;
         self->io_ival = 0.0;
         self->timeout_ival = 0.0;
+        self->idle = NULL;
+        self->prepare = NULL;
+        self->check = NULL;
+        self->queue = NULL;
+        self->queue_len = 0;
+        self->queue_size = 0;
+        self->queue_seq = 0;
+        self->backlog = 0;
+        self->collecting = 0;
+        self->dispatching = 0;
+        self->max_events = 0;
+        self->max_time = 0.0;
+        self->aging_ival = 0;
+        self->aging_time = 0.0;
+        self->edf = 0;
+        memset(self->waits, 0, sizeof(self->waits));
+        self->adaptive_min = 0.0;
+        self->adaptive_max = 0.0;
+        self->poll_start = 0.0;
+        self->busy_poll = 0;
+        self->busy_poll_sockets = 0;
+        self->spin_hits = 0;
+        self->spin_misses = 0;
+        self->spinning = 0;
+        self->spun = 0;
+        self->checks = 0;
+        self->idles = 0;
+        self->polled = 0;
+        self->stopped = 0;
+        self->hold_gil = 0;
+        self->tstate = NULL;
+        self->soon = NULL;
+        self->calls = NULL;
+        self->calls_head = 0;
+        self->calls_len = 0;
+        self->calls_size = 0;
+        self->max_calls = 0;
+        self->async = NULL;
+        Mailbox_init(&self->mailbox);
+        self->natives = NULL;
+        self->natives_len = 0;
+        self->natives_size = 0;
+        __Loop_init_natives_lock__(self);
     }
     return self;
 }
@@ -85,10 +1175,52 @@ __Loop_post_alloc__(Loop *self, PyObject *args, PyObject *kwargs, int _default_)
     _Py_CHECK_CALLABLE_OR_NONE(callback, -1);
     _Py_CHECK_POSITIVE_OR_ZERO_FLOAT(io_ival, -1);
     _Py_CHECK_POSITIVE_OR_ZERO_FLOAT(timeout_ival, -1);
+    if (!(self->errors = PyList_New(0))) {
+        return -1;
+    }
     _Py_SET_MEMBER(self->callback, callback);
     _Py_SET_MEMBER(self->data, data);
+    _Py_SET_MEMBER(self->batch, Py_None);
     __Loop_set_interval__(self, io, io_ival);
     __Loop_set_interval__(self, timeout, timeout_ival);
+#if EV_IDLE_ENABLE
+    if (!(self->idle = PyMem_Malloc(sizeof(ev_idle)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    ev_idle_init(self->idle, __ev_loop_idle__);
+    ev_set_priority(self->idle, EV_MINPRI);
+#endif
+#if EV_PREPARE_ENABLE && EV_CHECK_ENABLE
+    if (
+        !(self->prepare = PyMem_Malloc(sizeof(ev_prepare))) ||
+        !(self->check = PyMem_Malloc(sizeof(ev_check)))
+    ) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    // last prepare and first check watchers to run, closest to the poll
+    ev_prepare_init(self->prepare, __ev_loop_prepare__);
+    ev_set_priority(self->prepare, EV_MINPRI);
+    ev_check_init(self->check, __ev_loop_check__);
+    ev_set_priority(self->check, EV_MAXPRI);
+#endif
+#if EV_PREPARE_ENABLE
+    if (!(self->soon = PyMem_Malloc(sizeof(ev_prepare)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    ev_prepare_init(self->soon, __ev_loop_soon__);
+#endif
+#if EV_ASYNC_ENABLE
+    if (!(self->async = PyMem_Malloc(sizeof(ev_async)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    ev_async_init(self->async, __ev_loop_mailbox__);
+    ev_set_priority(self->async, EV_MAXPRI);
+    __Loop_start_internal__(self, async, self->async);
+#endif
     ev_set_userdata(self->loop, self);
     ev_set_invoke_pending_cb(self->loop, __ev_loop_invoke__);
     return 0;
@@ -107,6 +1239,21 @@ __Loop_finalize__(Loop *self)
 static int
 __Loop_traverse__(Loop *self, visitproc visit, void *arg)
 {
+    Py_ssize_t i;
+    int result = 0;
+
+    for (i = 0; i < self->queue_len; i++) {
+        Py_VISIT(self->queue[i].watcher);
+    }
+    for (i = 0; i < self->calls_len; i++) {
+        Py_VISIT(__Loop_call_at__(self, i)->callback);
+        Py_VISIT(__Loop_call_at__(self, i)->args);
+    }
+    if ((result = Mailbox_traverse(&self->mailbox, visit, arg))) {
+        return result;
+    }
+    Py_VISIT(self->errors);
+    Py_VISIT(self->batch);
     Py_VISIT(self->data);
     Py_VISIT(self->callback);
     return 0;
@@ -116,6 +1263,11 @@ __Loop_traverse__(Loop *self, visitproc visit, void *arg)
 static int
 __Loop_clear__(Loop *self)
 {
+    __Loop_clear_queue__(self);
+    __Loop_clear_calls__(self);
+    Mailbox_clear(&self->mailbox);
+    Py_CLEAR(self->errors);
+    Py_CLEAR(self->batch);
     Py_CLEAR(self->data);
     Py_CLEAR(self->callback);
     return 0;
@@ -132,6 +1284,39 @@ __Loop_dealloc__(Loop *self)
         ev_loop_destroy(self->loop);
         self->loop = NULL;
     }
+    if (self->idle) {
+        PyMem_Free(self->idle);
+        self->idle = NULL;
+    }
+    if (self->prepare) {
+        PyMem_Free(self->prepare);
+        self->prepare = NULL;
+    }
+    if (self->check) {
+        PyMem_Free(self->check);
+        self->check = NULL;
+    }
+    if (self->queue) {
+        PyMem_Free(self->queue);
+        self->queue = NULL;
+    }
+    if (self->soon) {
+        PyMem_Free(self->soon);
+        self->soon = NULL;
+    }
+    if (self->async) {
+        PyMem_Free(self->async);
+        self->async = NULL;
+    }
+    if (self->natives) {
+        PyMem_RawFree(self->natives);
+        self->natives = NULL;
+    }
+    pthread_mutex_destroy(&self->natives_lock);
+    if (self->calls) {
+        PyMem_Free(self->calls);
+        self->calls = NULL;
+    }
     PyObject_GC_Del(self);
 }
 
@@ -235,9 +1420,22 @@ Loop_start(Loop *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "|i:start", &flags)) {
         return NULL;
     }
-    Py_BEGIN_ALLOW_THREADS
-    result = ev_run(self->loop, flags);
-    Py_END_ALLOW_THREADS
+    self->stopped = 0;
+    if (self->hold_gil) {
+        result = ev_run(self->loop, flags);
+    }
+    else {
+        Py_BEGIN_ALLOW_THREADS
+        if (self->busy_poll && !flags) {
+            do {
+                result = __Loop_spin__(self);
+            } while (result && !self->stopped);
+        }
+        else {
+            result = ev_run(self->loop, flags);
+        }
+        Py_END_ALLOW_THREADS
+    }
     if (PyErr_Occurred() || PyErr_CheckSignals()) {
         return NULL;
     }
@@ -254,21 +1452,91 @@ Loop_stop(Loop *self, PyObject *args)
     if (!PyArg_ParseTuple(args, "|i:stop", &how)) {
         return NULL;
     }
+    self->stopped = (how != EVBREAK_CANCEL);
     ev_break(self->loop, how);
     Py_RETURN_NONE;
 }
 
 
-/* Loop.invoke() */
+/* Loop.invoke([max_events=None, max_time=None, min_priority=EV_MINPRI]) */
 static PyObject *
-Loop_invoke(Loop *self)
+Loop_invoke(Loop *self, PyObject *args, PyObject *kwargs)
 {
-    ev_invoke_pending(self->loop);
-    if (PyErr_Occurred()) {
+    static char *kwlist[] = {"max_events", "max_time", "min_priority", NULL};
+    PyObject *max_events = Py_None, *max_time = Py_None;
+    Budget budget = {0, 0.0, EV_MINPRI};
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|OOi:invoke", kwlist,
+            &max_events, &max_time, &budget.min_priority
+        ) ||
+        __Loop_count_or_none__(max_events, &budget.max_events) ||
+        __Loop_time_or_none__(max_time, &budget.max_time) ||
+        __Loop_invoke__(self, &budget)
+    ) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Loop.call_soon(callback, *args) */
+#if EV_PREPARE_ENABLE
+static PyObject *
+Loop_call_soon(Loop *self, PyObject *args)
+{
+    Py_ssize_t size = PyTuple_GET_SIZE(args);
+    PyObject *callback = NULL, *_args_ = NULL;
+    int result = -1;
+
+    if (size < 1) {
+        PyErr_SetString(
+            PyExc_TypeError, "call_soon() missing required argument 'callback'"
+        );
+        return NULL;
+    }
+    callback = PyTuple_GET_ITEM(args, 0);
+    _Py_CHECK_CALLABLE(callback, NULL);
+    if ((_args_ = PyTuple_GetSlice(args, 1, size))) {
+        result = __Loop_call_soon__(self, callback, _args_);
+        Py_DECREF(_args_);
+    }
+    if (result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+#endif
+
+
+/* Loop.submit(callback, *args) */
+#if EV_ASYNC_ENABLE
+static PyObject *
+Loop_submit(Loop *self, PyObject *args)
+{
+    Py_ssize_t size = PyTuple_GET_SIZE(args);
+    PyObject *callback = NULL, *_args_ = NULL;
+    int result = -1;
+
+    if (size < 1) {
+        PyErr_SetString(
+            PyExc_TypeError, "submit() missing required argument 'callback'"
+        );
+        return NULL;
+    }
+    callback = PyTuple_GET_ITEM(args, 0);
+    _Py_CHECK_CALLABLE(callback, NULL);
+    if ((_args_ = PyTuple_GetSlice(args, 1, size))) {
+        result = Loop_post(self, callback, NULL, _args_);
+        Py_DECREF(_args_);
+    }
+    if (result) {
         return NULL;
     }
     Py_RETURN_NONE;
 }
+#endif
 
 
 /* Loop.reset() */
@@ -368,6 +1636,59 @@ Loop_feed_signal_event(Loop *self, PyObject *args)
 #endif
 
 
+/* Loop.wait_stats([reset]) -> dict */
+static PyObject *
+Loop_wait_stats(Loop *self, PyObject *args)
+{
+    int reset = 0, priority;
+    PyObject *result = NULL, *key = NULL, *value = NULL;
+    Waits *waits = NULL;
+
+    if (
+        !PyArg_ParseTuple(args, "|p:wait_stats", &reset) ||
+        !(result = PyDict_New())
+    ) {
+        return NULL;
+    }
+    for (priority = EV_MINPRI; priority <= EV_MAXPRI; priority++) {
+        waits = &self->waits[priority - EV_MINPRI];
+        key = PyLong_FromLong(priority);
+        value = Py_BuildValue(
+            "kdd",
+            waits->count,
+            waits->count ? (waits->total / waits->count) : 0.0,
+            waits->max
+        );
+        if (!key || !value || PyDict_SetItem(result, key, value)) {
+            Py_XDECREF(key);
+            Py_XDECREF(value);
+            Py_CLEAR(result);
+            return NULL;
+        }
+        Py_DECREF(key);
+        Py_DECREF(value);
+    }
+    if (reset) {
+        memset(self->waits, 0, sizeof(self->waits));
+    }
+    return result;
+}
+
+
+/* Loop.pop_errors() -> list */
+static PyObject *
+Loop_pop_errors(Loop *self)
+{
+    PyObject *result = self->errors;
+
+    if (!(self->errors = PyList_New(0))) {
+        self->errors = result;
+        return NULL;
+    }
+    return result;
+}
+
+
 /* Loop.verify() */
 static PyObject *
 Loop_verify(Loop *self)
@@ -511,9 +1832,91 @@ Loop___async__(Loop *self, PyObject *args, PyObject *kwargs)
 {
     return __Loop_Watcher__(self, &Async_Type, args, kwargs);
 }
+
+
+/* Loop.__asyncqueue__() */
+static PyObject *
+Loop___asyncqueue__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &AsyncQueue_Type, args, kwargs);
+}
+#endif
+
+
+/* Loop.__nativeio__() */
+static PyObject *
+Loop___nativeio__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &NativeIo_Type, args, kwargs);
+}
+
+
+/* Loop.__filesender__() */
+static PyObject *
+Loop___filesender__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &FileSender_Type, args, kwargs);
+}
+
+
+/* Loop.__splice__() */
+static PyObject *
+Loop___splice__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &Splice_Type, args, kwargs);
+}
+
+
+/* Loop.__stream__() */
+static PyObject *
+Loop___stream__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &Stream_Type, args, kwargs);
+}
+
+
+/* Loop.__tlsstream__() */
+static PyObject *
+Loop___tlsstream__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &TLSStream_Type, args, kwargs);
+}
+
+
+/* Loop.__listener__() */
+static PyObject *
+Loop___listener__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &Listener_Type, args, kwargs);
+}
+
+
+/* Loop.__connector__() */
+static PyObject *
+Loop___connector__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &Connector_Type, args, kwargs);
+}
+
+
+#if EV_ASYNC_ENABLE
+/* Loop.__iomux__() */
+static PyObject *
+Loop___iomux__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &IoMux_Type, args, kwargs);
+}
 #endif
 
 
+/* Loop.__datagram__() */
+static PyObject *
+Loop___datagram__(Loop *self, PyObject *args, PyObject *kwargs)
+{
+    return __Loop_Watcher__(self, &Datagram_Type, args, kwargs);
+}
+
+
 /* Loop_Type.tp_methods */
 static PyMethodDef Loop_tp_methods[] = {
     {
@@ -531,9 +1934,25 @@ static PyMethodDef Loop_tp_methods[] = {
     {
         "invoke",
         (PyCFunction)Loop_invoke,
-        METH_NOARGS,
-        "invoke()"
+        METH_VARARGS | METH_KEYWORDS,
+        "invoke([max_events=None, max_time=None, min_priority=EV_MINPRI])"
+    },
+#if EV_PREPARE_ENABLE
+    {
+        "call_soon",
+        (PyCFunction)Loop_call_soon,
+        METH_VARARGS,
+        "call_soon(callback, *args)"
+    },
+#endif
+#if EV_ASYNC_ENABLE
+    {
+        "submit",
+        (PyCFunction)Loop_submit,
+        METH_VARARGS,
+        "submit(callback, *args)"
     },
+#endif
     {
         "reset",
         (PyCFunction)Loop_reset,
@@ -584,6 +2003,18 @@ static PyMethodDef Loop_tp_methods[] = {
         "feed_signal_event(signum)"
     },
 #endif
+    {
+        "wait_stats",
+        (PyCFunction)Loop_wait_stats,
+        METH_VARARGS,
+        "wait_stats([reset]) -> dict"
+    },
+    {
+        "pop_errors",
+        (PyCFunction)Loop_pop_errors,
+        METH_NOARGS,
+        "pop_errors() -> list"
+    },
     {
         "verify",
         (PyCFunction)Loop_verify,
@@ -672,17 +2103,79 @@ static PyMethodDef Loop_tp_methods[] = {
         "__fork__",
         (PyCFunction)Loop___fork__,
         METH_VARARGS | METH_KEYWORDS,
-        "__fork__(callback[, data=None, priority=0]) -> Fork"
+        "__fork__(callback[, data=None, priority=0]) -> Fork"
+    },
+#endif
+#if EV_ASYNC_ENABLE
+    {
+        "__async__",
+        (PyCFunction)Loop___async__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__async__(callback[, data=None, priority=0]) -> Async"
+    },
+    {
+        "__asyncqueue__",
+        (PyCFunction)Loop___asyncqueue__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__asyncqueue__(callback[, data=None, priority=0]) -> AsyncQueue"
+    },
+#endif
+    {
+        "__nativeio__",
+        (PyCFunction)Loop___nativeio__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__nativeio__(fd, events, handler[, target=None, callback=None, data=None, priority=0]) -> NativeIo"
+    },
+    {
+        "__filesender__",
+        (PyCFunction)Loop___filesender__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__filesender__(fd, file, offset, count, callback[, data=None, priority=0]) -> FileSender"
+    },
+    {
+        "__splice__",
+        (PyCFunction)Loop___splice__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__splice__(fd, target, callback[, data=None, priority=0]) -> Splice"
+    },
+    {
+        "__stream__",
+        (PyCFunction)Loop___stream__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__stream__(fd, framer, callback[, data=None, priority=0]) -> Stream"
+    },
+    {
+        "__tlsstream__",
+        (PyCFunction)Loop___tlsstream__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__tlsstream__(fd, framer, context, callback[, data=None, priority=0, server_hostname=None, ktls=False, check_hostname=True]) -> TLSStream"
+    },
+    {
+        "__listener__",
+        (PyCFunction)Loop___listener__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__listener__(fd, callback[, data=None, priority=0]) -> Listener"
+    },
+    {
+        "__connector__",
+        (PyCFunction)Loop___connector__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__connector__(addresses, timeout, callback[, data=None, priority=0, delay=0.25]) -> Connector"
     },
-#endif
 #if EV_ASYNC_ENABLE
     {
-        "__async__",
-        (PyCFunction)Loop___async__,
+        "__iomux__",
+        (PyCFunction)Loop___iomux__,
         METH_VARARGS | METH_KEYWORDS,
-        "__async__(callback[, data=None, priority=0]) -> Async"
+        "__iomux__(callback[, data=None, priority=0, batch=False]) -> IoMux"
     },
 #endif
+    {
+        "__datagram__",
+        (PyCFunction)Loop___datagram__,
+        METH_VARARGS | METH_KEYWORDS,
+        "__datagram__(fd, callback[, data=None, priority=0]) -> Datagram"
+    },
     {NULL}
 };
 
@@ -722,6 +2215,23 @@ Loop_data_setter(Loop *self, PyObject *value, void *closure)
 }
 
 
+/* Loop.batch */
+static PyObject *
+Loop_batch_getter(Loop *self, void *closure)
+{
+    return Py_NewRef(self->batch);
+}
+
+static int
+Loop_batch_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    _Py_CHECK_CALLABLE_OR_NONE(value, -1);
+    _Py_SET_MEMBER(self->batch, value);
+    return 0;
+}
+
+
 /* Loop.io_interval/Loop.timeout_interval */
 static PyObject *
 Loop_interval_getter(Loop *self, void *closure)
@@ -739,6 +2249,13 @@ Loop_interval_setter(Loop *self, PyObject *value, void *closure)
         return -1;
     }
     _Py_CHECK_POSITIVE_OR_ZERO_FLOAT(ival, -1);
+    if (closure && ival && self->hold_gil) {
+        // libev sleeps outside of the release/acquire callbacks
+        PyErr_SetString(
+            EventError, "cannot set 'io_interval' while holding the GIL"
+        );
+        return -1;
+    }
     if (closure) {
         __Loop_set_interval__(self, io, ival);
     }
@@ -749,6 +2266,294 @@ Loop_interval_setter(Loop *self, PyObject *value, void *closure)
 }
 
 
+#if EV_PREPARE_ENABLE && EV_CHECK_ENABLE
+/* Loop.adaptive */
+static PyObject *
+Loop_adaptive_getter(Loop *self, void *closure)
+{
+    if (!self->adaptive_max) {
+        Py_RETURN_NONE;
+    }
+    return Py_BuildValue("dd", self->adaptive_min, self->adaptive_max);
+}
+
+static int
+Loop_adaptive_setter(Loop *self, PyObject *value, void *closure)
+{
+    double min = 0.0, max = 0.0;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (
+        (value != Py_None) &&
+        !PyArg_Parse(
+            value, "(dd);a (min, max) tuple or None is required", &min, &max
+        )
+    ) {
+        return -1;
+    }
+    if (value != Py_None) {
+        _Py_CHECK_POSITIVE_OR_ZERO_FLOAT(min, -1);
+        if (max <= min) {
+            PyErr_SetString(
+                PyExc_ValueError, "'max' must be bigger than 'min'"
+            );
+            return -1;
+        }
+        if (self->hold_gil) {
+            PyErr_SetString(
+                EventError, "cannot set 'adaptive' while holding the GIL"
+            );
+            return -1;
+        }
+    }
+    return __Loop_set_adaptive__(self, min, max);
+}
+#endif
+
+
+/* Loop.hold_gil */
+static PyObject *
+Loop_hold_gil_getter(Loop *self, void *closure)
+{
+    return PyBool_FromLong(self->hold_gil);
+}
+
+static int
+Loop_hold_gil_setter(Loop *self, PyObject *value, void *closure)
+{
+    int hold_gil = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if ((hold_gil = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    if (ev_depth(self->loop)) {
+        PyErr_SetString(
+            EventError, "cannot set 'hold_gil' while the loop is running"
+        );
+        return -1;
+    }
+    if (hold_gil && (self->io_ival || self->adaptive_max)) {
+        // libev sleeps io_interval outside of the release/acquire callbacks,
+        // i.e. with the GIL held
+        PyErr_SetString(
+            EventError,
+            "cannot set 'hold_gil' with an 'io_interval' or 'adaptive' set"
+        );
+        return -1;
+    }
+    if ((self->hold_gil = hold_gil)) {
+        ev_set_loop_release_cb(
+            self->loop, __ev_loop_release__, __ev_loop_acquire__
+        );
+    }
+    else {
+        ev_set_loop_release_cb(self->loop, NULL, NULL);
+    }
+    return 0;
+}
+
+
+/* Loop.busy_poll */
+static PyObject *
+Loop_busy_poll_getter(Loop *self, void *closure)
+{
+    return PyLong_FromLong(self->busy_poll);
+}
+
+static int
+Loop_busy_poll_setter(Loop *self, PyObject *value, void *closure)
+{
+    long busy_poll = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((busy_poll = PyLong_AsLong(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (busy_poll < 0) {
+        PyErr_SetString(PyExc_ValueError, "a positive int or 0 is required");
+        return -1;
+    }
+    self->busy_poll = busy_poll;
+    return 0;
+}
+
+
+/* Loop.busy_poll_sockets */
+static PyObject *
+Loop_busy_poll_sockets_getter(Loop *self, void *closure)
+{
+    return PyBool_FromLong(self->busy_poll_sockets);
+}
+
+static int
+Loop_busy_poll_sockets_setter(Loop *self, PyObject *value, void *closure)
+{
+    int busy_poll_sockets = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if ((busy_poll_sockets = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    self->busy_poll_sockets = busy_poll_sockets;
+    return 0;
+}
+
+
+/* Loop.spin_hits/Loop.spin_misses */
+static PyObject *
+Loop_spin_getter(Loop *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(
+        closure ? self->spin_hits : self->spin_misses
+    );
+}
+
+
+/* Loop.max_errors */
+static PyObject *
+Loop_max_errors_getter(Loop *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->max_errors);
+}
+
+static int
+Loop_max_errors_setter(Loop *self, PyObject *value, void *closure)
+{
+    Py_ssize_t max_errors = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((max_errors = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (max_errors < 0) {
+        PyErr_SetString(PyExc_ValueError, "a positive int or 0 is required");
+        return -1;
+    }
+    self->max_errors = max_errors;
+    return 0;
+}
+
+
+/* Loop.errors_dropped */
+static PyObject *
+Loop_errors_dropped_getter(Loop *self, void *closure)
+{
+    return PyLong_FromUnsignedLong(self->errors_dropped);
+}
+
+
+/* Loop.max_calls */
+static PyObject *
+Loop_max_calls_getter(Loop *self, void *closure)
+{
+    if (self->max_calls) {
+        return PyLong_FromSsize_t(self->max_calls);
+    }
+    Py_RETURN_NONE;
+}
+
+static int
+Loop_max_calls_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Loop_count_or_none__(value, &self->max_calls);
+}
+
+
+/* Loop.max_events */
+static PyObject *
+Loop_max_events_getter(Loop *self, void *closure)
+{
+    if (!self->max_events) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromSsize_t(self->max_events);
+}
+
+static int
+Loop_max_events_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Loop_count_or_none__(value, &self->max_events);
+}
+
+
+/* Loop.max_time */
+static PyObject *
+Loop_max_time_getter(Loop *self, void *closure)
+{
+    if (!self->max_time) {
+        Py_RETURN_NONE;
+    }
+    return PyFloat_FromDouble(self->max_time);
+}
+
+static int
+Loop_max_time_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Loop_time_or_none__(value, &self->max_time);
+}
+
+
+/* Loop.aging_iterations */
+static PyObject *
+Loop_aging_iterations_getter(Loop *self, void *closure)
+{
+    if (!self->aging_ival) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromSsize_t(self->aging_ival);
+}
+
+static int
+Loop_aging_iterations_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Loop_count_or_none__(value, &self->aging_ival);
+}
+
+
+/* Loop.aging_time */
+static PyObject *
+Loop_aging_time_getter(Loop *self, void *closure)
+{
+    if (!self->aging_time) {
+        Py_RETURN_NONE;
+    }
+    return PyFloat_FromDouble(self->aging_time);
+}
+
+static int
+Loop_aging_time_setter(Loop *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Loop_time_or_none__(value, &self->aging_time);
+}
+
+
+/* Loop.edf */
+static PyObject *
+Loop_edf_getter(Loop *self, void *closure)
+{
+    return PyBool_FromLong(self->edf);
+}
+
+static int
+Loop_edf_setter(Loop *self, PyObject *value, void *closure)
+{
+    int edf = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if ((edf = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    self->edf = edf;
+    return 0;
+}
+
+
 /* Loop.default */
 static PyObject *
 Loop_default_getter(Loop *self, void *closure)
@@ -785,7 +2590,9 @@ Loop_backend_getter(Loop *self, void *closure)
 static PyObject *
 Loop_pending_getter(Loop *self, void *closure)
 {
-    return PyLong_FromUnsignedLong(ev_pending_count(self->loop));
+    return PyLong_FromSize_t(
+        ev_pending_count(self->loop) + __Loop_queued__(self)
+    );
 }
 
 
@@ -805,6 +2612,13 @@ static PyGetSetDef Loop_tp_getsets[] = {
         NULL,
         NULL
     },
+    {
+        "batch",
+        (getter)Loop_batch_getter,
+        (setter)Loop_batch_setter,
+        NULL,
+        NULL
+    },
     {
         "io_interval",
         (getter)Loop_interval_getter,
@@ -819,6 +2633,106 @@ static PyGetSetDef Loop_tp_getsets[] = {
         NULL,
         NULL
     },
+#if EV_PREPARE_ENABLE && EV_CHECK_ENABLE
+    {
+        "adaptive",
+        (getter)Loop_adaptive_getter,
+        (setter)Loop_adaptive_setter,
+        NULL,
+        NULL
+    },
+#endif
+    {
+        "hold_gil",
+        (getter)Loop_hold_gil_getter,
+        (setter)Loop_hold_gil_setter,
+        NULL,
+        NULL
+    },
+    {
+        "busy_poll",
+        (getter)Loop_busy_poll_getter,
+        (setter)Loop_busy_poll_setter,
+        NULL,
+        NULL
+    },
+    {
+        "busy_poll_sockets",
+        (getter)Loop_busy_poll_sockets_getter,
+        (setter)Loop_busy_poll_sockets_setter,
+        NULL,
+        NULL
+    },
+    {
+        "spin_hits",
+        (getter)Loop_spin_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        Py_True
+    },
+    {
+        "spin_misses",
+        (getter)Loop_spin_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "max_errors",
+        (getter)Loop_max_errors_getter,
+        (setter)Loop_max_errors_setter,
+        NULL,
+        NULL
+    },
+    {
+        "errors_dropped",
+        (getter)Loop_errors_dropped_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "max_calls",
+        (getter)Loop_max_calls_getter,
+        (setter)Loop_max_calls_setter,
+        NULL,
+        NULL
+    },
+    {
+        "max_events",
+        (getter)Loop_max_events_getter,
+        (setter)Loop_max_events_setter,
+        NULL,
+        NULL
+    },
+    {
+        "max_time",
+        (getter)Loop_max_time_getter,
+        (setter)Loop_max_time_setter,
+        NULL,
+        NULL
+    },
+    {
+        "aging_iterations",
+        (getter)Loop_aging_iterations_getter,
+        (setter)Loop_aging_iterations_setter,
+        NULL,
+        NULL
+    },
+    {
+        "aging_time",
+        (getter)Loop_aging_time_getter,
+        (setter)Loop_aging_time_setter,
+        NULL,
+        NULL
+    },
+    {
+        "edf",
+        (getter)Loop_edf_getter,
+        (setter)Loop_edf_setter,
+        NULL,
+        NULL
+    },
     {
         "default",
         (getter)Loop_default_getter,
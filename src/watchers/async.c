@@ -76,4 +76,314 @@ PyTypeObject Async_Type = {
 };
 
 
+/* ========================================================================== */
+
+/* helpers ------------------------------------------------------------------ */
+
+#define __AsyncQueue_send__(Q) \
+    ev_async_send( \
+        ((Watcher *)(Q))->loop->loop, ((ev_async *)((Watcher *)(Q))->watcher) \
+    )
+
+
+// any thread
+static int
+__AsyncQueue_push__(AsyncQueue *self, PyObject *object, PyObject *args)
+{
+    Message *message = NULL;
+
+    if (!(message = Message_new(object, NULL, args))) {
+        return -1;
+    }
+    // only the first push since the last drain has to wake up the loop
+    if (Mailbox_post(&self->mailbox, message)) {
+        __AsyncQueue_send__(self);
+    }
+    return 0;
+}
+
+
+static PyObject *
+__AsyncQueue_drain__(AsyncQueue *self)
+{
+    ev_loop *loop = ((Watcher *)self)->loop->loop;
+    PyObject *items = NULL, *result = NULL;
+    Message *message = NULL, *first = NULL, *last = NULL;
+    Py_ssize_t i, count = 0;
+
+    Mailbox_collect(&self->mailbox);
+    // items are set aside while the calls are made, on error they are put
+    // back, with the remaining messages, for the next drain
+    while (!PyErr_Occurred() && (message = Mailbox_pop(&self->mailbox))) {
+        if (!message->args) {
+            message->next = NULL;
+            if (last) {
+                last->next = message;
+            }
+            else {
+                first = message;
+            }
+            last = message;
+            count++;
+            continue;
+        }
+        if ((result = Message_apply(message))) {
+            Py_DECREF(result);
+        }
+        else if (!ev_loop_defer(loop, (PyObject *)self, message->object)) {
+            ev_loop_warn(loop, message->object);
+        }
+        Message_free(message);
+    }
+    if (!PyErr_Occurred() && (items = PyList_New(count))) {
+        for (i = 0; (message = first); i++) {
+            first = message->next;
+            PyList_SET_ITEM(items, i, Py_NewRef(message->object));
+            Message_free(message);
+        }
+    }
+    if (first) {
+        Mailbox_restore(&self->mailbox, first, last);
+    }
+    return items;
+}
+
+
+static void
+__ev_async_queue_invoke__(ev_loop *loop, ev_async *async, int revents)
+{
+    Watcher *self = async->data;
+    PyObject *items = NULL;
+
+    if ((revents & EV_ERROR) || self->loop->collecting) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)async, revents);
+        return;
+    }
+    if (
+        !__Watcher_invoke_verify__(self) &&
+        (items = __AsyncQueue_drain__((AsyncQueue *)self))
+    ) {
+        if ((self->callback != Py_None) && PyList_GET_SIZE(items)) {
+            __Watcher_invoke_callback__(self, items);
+        }
+        Py_DECREF(items);
+    }
+    if (
+        PyErr_Occurred() ||
+        (!self->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        // what was left behind will not wake up the loop on its own
+        if (Mailbox_pending(&((AsyncQueue *)self)->mailbox)) {
+            __AsyncQueue_send__(self);
+        }
+        ev_loop_stop(loop);
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   AsyncQueue
+   -------------------------------------------------------------------------- */
+
+static AsyncQueue *
+__AsyncQueue_alloc__(PyTypeObject *type)
+{
+    AsyncQueue *self = NULL;
+
+    if ((self = (AsyncQueue *)__Watcher_alloc__(type))) {
+        Mailbox_init(&self->mailbox);
+    }
+    return self;
+}
+
+
+static int
+__AsyncQueue_post_alloc__(AsyncQueue *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    ev_set_cb(((ev_async *)watcher->watcher), __ev_async_queue_invoke__);
+    return 0;
+}
+
+
+static int
+__AsyncQueue_traverse__(AsyncQueue *self, visitproc visit, void *arg)
+{
+    int result = 0;
+
+    if ((result = Mailbox_traverse(&self->mailbox, visit, arg))) {
+        return result;
+    }
+    return __Watcher_traverse__((Watcher *)self, visit, arg);
+}
+
+
+static int
+__AsyncQueue_clear__(AsyncQueue *self)
+{
+    Mailbox_clear(&self->mailbox);
+    return __Watcher_clear__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* AsyncQueue_Type.tp_dealloc */
+static void
+AsyncQueue_tp_dealloc(AsyncQueue *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __AsyncQueue_clear__(self);
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* AsyncQueue_Type.tp_traverse */
+static int
+AsyncQueue_tp_traverse(AsyncQueue *self, visitproc visit, void *arg)
+{
+    return __AsyncQueue_traverse__(self, visit, arg);
+}
+
+
+/* AsyncQueue_Type.tp_clear */
+static int
+AsyncQueue_tp_clear(AsyncQueue *self)
+{
+    return __AsyncQueue_clear__(self);
+}
+
+
+/* AsyncQueue_Type.tp_new */
+static PyObject *
+AsyncQueue_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    AsyncQueue *self = NULL;
+
+    if ((self = __AsyncQueue_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__AsyncQueue_post_alloc__(self, EV_ASYNC, sizeof(ev_async))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* AsyncQueue.start() */
+static PyObject *
+AsyncQueue_start(AsyncQueue *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    ev_async_start(watcher->loop->loop, ((ev_async *)watcher->watcher));
+    // items pushed while we were stopped did not wake up the loop
+    if (Mailbox_pending(&self->mailbox)) {
+        __AsyncQueue_send__(self);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* AsyncQueue.put(item) */
+static PyObject *
+AsyncQueue_put(AsyncQueue *self, PyObject *item)
+{
+    if (__AsyncQueue_push__(self, item, NULL)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* AsyncQueue.call_soon(callback, *args) */
+static PyObject *
+AsyncQueue_call_soon(AsyncQueue *self, PyObject *args)
+{
+    Py_ssize_t size = PyTuple_GET_SIZE(args);
+    PyObject *callback = NULL, *_args_ = NULL;
+    int result = -1;
+
+    if (size < 1) {
+        PyErr_SetString(
+            PyExc_TypeError, "call_soon() missing required argument 'callback'"
+        );
+        return NULL;
+    }
+    callback = PyTuple_GET_ITEM(args, 0);
+    _Py_CHECK_CALLABLE(callback, NULL);
+    if ((_args_ = PyTuple_GetSlice(args, 1, size))) {
+        result = __AsyncQueue_push__(self, callback, _args_);
+        Py_DECREF(_args_);
+    }
+    if (result) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* AsyncQueue.drain() -> list */
+static PyObject *
+AsyncQueue_drain(AsyncQueue *self)
+{
+    return __AsyncQueue_drain__(self);
+}
+
+
+/* AsyncQueue_Type.tp_methods */
+static PyMethodDef AsyncQueue_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)AsyncQueue_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "put",
+        (PyCFunction)AsyncQueue_put,
+        METH_O,
+        "put(item)"
+    },
+    {
+        "call_soon",
+        (PyCFunction)AsyncQueue_call_soon,
+        METH_VARARGS,
+        "call_soon(callback, *args)"
+    },
+    {
+        "drain",
+        (PyCFunction)AsyncQueue_drain,
+        METH_NOARGS,
+        "drain() -> list"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject AsyncQueue_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.AsyncQueue",
+    .tp_basicsize = sizeof(AsyncQueue),
+    .tp_dealloc = (destructor)AsyncQueue_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "AsyncQueue(loop, callback[, data=None, priority=0])",
+    .tp_traverse = (traverseproc)AsyncQueue_tp_traverse,
+    .tp_clear = (inquiry)AsyncQueue_tp_clear,
+    .tp_methods = AsyncQueue_tp_methods,
+    .tp_new = (newfunc)AsyncQueue_tp_new,
+};
+
+
 #endif // !EV_ASYNC_ENABLE
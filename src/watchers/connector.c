@@ -0,0 +1,707 @@
+#include "watcher.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/* helpers ------------------------------------------------------------------ */
+
+// RFC 8305 recommends 250ms between attempts
+#define __CONNECTOR_DELAY__ 0.25
+
+
+static int
+__Connector_inflight__(Connector *self)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < self->next; i++) {
+        if (ev_is_active(&self->ios[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+__Connector_release__(Connector *self, ev_io *io)
+{
+    int fd = io->fd;
+
+    ev_io_stop(((Watcher *)self)->loop->loop, io);
+    ev_io_set(io, -1, EV_WRITE);
+    return fd;
+}
+
+
+// stops the timer and closes all attempts in progress
+static void
+__Connector_stop__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    Py_ssize_t i;
+
+    ev_timer_stop(watcher->loop->loop, (ev_timer *)watcher->watcher);
+    for (i = 0; i < self->next; i++) {
+        if (ev_is_active(&self->ios[i])) {
+            close(__Connector_release__(self, &self->ios[i]));
+        }
+    }
+}
+
+
+// drops a result that has not been reported yet
+static void
+__Connector_drop__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (self->done) {
+        ev_clear_pending(watcher->loop->loop, watcher->watcher);
+        watcher->queued = 0;
+        if (self->fd >= 0) {
+            close(self->fd);
+            self->fd = -1;
+        }
+        self->done = 0;
+    }
+}
+
+
+// the result is always reported from the timer callback
+static void
+__Connector_finish__(Connector *self, int fd, int error)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    __Connector_stop__(self);
+    self->fd = fd;
+    self->error = error;
+    self->done = 1;
+    ev_feed_event(watcher->loop->loop, watcher->watcher, EV_CUSTOM);
+}
+
+
+// returns the socket if connect() succeeded right away, -1 otherwise
+static int
+__Connector_attempt__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ConnectorAddress *address = NULL;
+    ev_io *io = NULL;
+    int fd = -1;
+
+    while (self->next < self->count) {
+        address = &self->addresses[self->next];
+        io = &self->ios[self->next++];
+        if (
+            (fd = socket(
+                address->family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0
+            )) < 0
+        ) {
+            self->error = errno;
+            continue;
+        }
+        if (
+            !connect(fd, (struct sockaddr *)&address->addr, address->addrlen)
+        ) {
+            return fd;
+        }
+        // EINTR: the connection is still established asynchronously
+        if ((errno == EINPROGRESS) || (errno == EINTR)) {
+            ev_io_set(io, fd, EV_WRITE);
+            ev_set_priority(io, ev_priority(watcher->watcher));
+            ev_io_start(watcher->loop->loop, io);
+            break;
+        }
+        self->error = errno;
+        close(fd);
+    }
+    return -1;
+}
+
+
+// the timer either starts the next attempt or expires the whole connect
+static void
+__Connector_schedule__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_loop *loop = watcher->loop->loop;
+    ev_timer *timer = (ev_timer *)watcher->watcher;
+    ev_tstamp after = self->expiry - ev_now(loop);
+
+    self->stagger = ((self->next < self->count) && (self->delay < after));
+    if (self->stagger) {
+        after = self->delay;
+    }
+    ev_timer_stop(loop, timer);
+    ev_timer_set(timer, (after > 0.0) ? after : 0.0, 0.0);
+    ev_timer_start(loop, timer);
+}
+
+
+static void
+__Connector_advance__(Connector *self)
+{
+    int fd = -1;
+
+    if ((fd = __Connector_attempt__(self)) >= 0) {
+        __Connector_finish__(self, fd, 0);
+    }
+    else if (!__Connector_inflight__(self)) {
+        __Connector_finish__(self, -1, self->error);
+    }
+    else {
+        __Connector_schedule__(self);
+    }
+}
+
+
+static void
+__Connector_report__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    PyObject *result = NULL;
+
+    self->done = 0;
+    if (
+        !__Watcher_invoke_verify__(watcher) &&
+        (watcher->callback != Py_None) &&
+        (result = (self->fd >= 0) ?
+         Py_BuildValue("(ii)", self->fd, self->error) :
+         Py_BuildValue("(Oi)", Py_None, self->error))
+    ) {
+        // the callback owns the socket from now on
+        self->fd = -1;
+        __Watcher_invoke_callback__(watcher, result);
+        Py_DECREF(result);
+    }
+    else if (self->fd >= 0) {
+        // nobody to hand it to
+        close(self->fd);
+        self->fd = -1;
+    }
+}
+
+
+static void
+__ev_connector_invoke__(ev_loop *loop, ev_timer *timer, int revents)
+{
+    Connector *self = timer->data;
+    Watcher *watcher = (Watcher *)self;
+
+    if ((revents & EV_ERROR) || (self->done && watcher->loop->collecting)) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)timer, revents);
+        return;
+    }
+    if (self->done) {
+        __Connector_report__(self);
+    }
+    else if (revents & EV_TIMER) {
+        if (self->stagger) {
+            __Connector_advance__(self);
+        }
+        else {
+            __Connector_finish__(self, -1, ETIMEDOUT);
+        }
+    }
+    if (
+        PyErr_Occurred() ||
+        (!watcher->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+// never enters Python, the result is reported by the timer
+static void
+__ev_connector_io_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    Connector *self = io->data;
+    int fd = __Connector_release__(self, io), error = 0;
+    socklen_t len = sizeof(error);
+
+    if (revents & EV_ERROR) {
+        error = errno ? errno : EBADF;
+    }
+    else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len)) {
+        error = errno;
+    }
+    if (!error) {
+        __Connector_finish__(self, fd, 0);
+        return;
+    }
+    close(fd);
+    self->error = error;
+    if (self->next < self->count) {
+        // don't wait for the delay, start the next attempt right away
+        __Connector_advance__(self);
+    }
+    else if (!__Connector_inflight__(self)) {
+        __Connector_finish__(self, -1, error);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static int
+__ConnectorAddress_set__(ConnectorAddress *address, PyObject *item)
+{
+    PyObject *family = NULL, *addr = NULL;
+
+    if (!PyTuple_Check(item)) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "addresses items must be tuples, not %.200s",
+            Py_TYPE(item)->tp_name
+        );
+        return -1;
+    }
+    switch (PyTuple_GET_SIZE(item)) {
+        case 2: // (family, address)
+            family = PyTuple_GET_ITEM(item, 0);
+            addr = PyTuple_GET_ITEM(item, 1);
+            break;
+        case 5: // getaddrinfo() entry
+            family = PyTuple_GET_ITEM(item, 0);
+            addr = PyTuple_GET_ITEM(item, 4);
+            break;
+        default:
+            PyErr_SetString(
+                PyExc_ValueError,
+                "addresses items must be (family, address) tuples or "
+                "getaddrinfo() entries"
+            );
+            return -1;
+    }
+    if (
+        (((address->family = _PyLong_AsInt(family)) == -1) &&
+         PyErr_Occurred()) ||
+        __Io_sockaddr__(
+            address->family, addr, &address->addr, &address->addrlen
+        )
+    ) {
+        return -1;
+    }
+    return 0;
+}
+
+
+// getaddrinfo() also returns SOCK_DGRAM/SOCK_RAW entries, skip them
+static int
+__ConnectorAddress_skip__(PyObject *item)
+{
+    int type = -1;
+
+    if (!PyTuple_Check(item) || (PyTuple_GET_SIZE(item) != 5)) {
+        return 0;
+    }
+    if (
+        ((type = _PyLong_AsInt(PyTuple_GET_ITEM(item, 1))) == -1) &&
+        PyErr_Occurred()
+    ) {
+        return -1;
+    }
+    return (type != SOCK_STREAM);
+}
+
+
+// alternate address families, starting with the first one (RFC 8305)
+static void
+__Connector_interleave__(
+    ConnectorAddress *dst, ConnectorAddress *src, Py_ssize_t count
+)
+{
+    Py_ssize_t a = 0, b = 0, n = 0;
+    int family = src[0].family;
+
+    while (n < count) {
+        while ((a < count) && (src[a].family != family)) {
+            a++;
+        }
+        if (a < count) {
+            dst[n++] = src[a++];
+        }
+        while ((b < count) && (src[b].family == family)) {
+            b++;
+        }
+        if (b < count) {
+            dst[n++] = src[b++];
+        }
+    }
+}
+
+
+static int
+__Connector_set__(Connector *self, PyObject *addresses)
+{
+    PyObject *seq = NULL, *item = NULL;
+    ConnectorAddress *parsed = NULL, *resized = NULL;
+    ev_io *ios = NULL;
+    Py_ssize_t size = 0, i, count = 0;
+    int skip = 0, result = -1;
+
+    if (!(seq = PySequence_Fast(addresses, "addresses must be iterable"))) {
+        return -1;
+    }
+    size = PySequence_Fast_GET_SIZE(seq);
+    if (!(parsed = PyMem_New(ConnectorAddress, size ? size : 1))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    for (i = 0; i < size; i++) {
+        item = PySequence_Fast_GET_ITEM(seq, i);
+        if ((skip = __ConnectorAddress_skip__(item)) < 0) {
+            goto exit;
+        }
+        if (!skip) {
+            if (__ConnectorAddress_set__(&parsed[count], item)) {
+                goto exit;
+            }
+            count++;
+        }
+    }
+    if (!count) {
+        PyErr_SetString(PyExc_ValueError, "no addresses to connect to");
+        goto exit;
+    }
+    if (
+        !(resized = PyMem_Realloc(
+            self->addresses, count * sizeof(ConnectorAddress)
+        ))
+    ) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    self->addresses = resized;
+    if (!(ios = PyMem_Realloc(self->ios, count * sizeof(ev_io)))) {
+        PyErr_NoMemory();
+        goto exit;
+    }
+    self->ios = ios;
+    __Connector_interleave__(self->addresses, parsed, count);
+    for (i = 0; i < count; i++) {
+        ev_io_init(&self->ios[i], __ev_connector_io_invoke__, -1, EV_WRITE);
+        self->ios[i].data = self;
+    }
+    self->count = count;
+    self->next = 0;
+    result = 0;
+
+exit:
+    PyMem_Free(parsed);
+    Py_DECREF(seq);
+    return result;
+}
+
+
+/* --------------------------------------------------------------------------
+   Connector
+   -------------------------------------------------------------------------- */
+
+static Connector *
+__Connector_alloc__(PyTypeObject *type)
+{
+    Connector *self = NULL;
+
+    if ((self = (Connector *)__Watcher_alloc__(type))) {
+        self->addresses = NULL;
+        self->ios = NULL;
+        self->count = 0;
+        self->next = 0;
+        self->timeout = 0.0;
+        self->delay = __CONNECTOR_DELAY__;
+        self->expiry = 0.0;
+        self->stagger = 0;
+        self->done = 0;
+        self->fd = -1;
+        self->error = 0;
+    }
+    return self;
+}
+
+
+static int
+__Connector_post_alloc__(Connector *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    ev_set_cb(((ev_timer *)watcher->watcher), __ev_connector_invoke__);
+    return 0;
+}
+
+
+static void
+__Connector_finalize__(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (watcher->watcher && watcher->loop && watcher->loop->loop) {
+        __Connector_stop__(self);
+        __Connector_drop__(self);
+    }
+}
+
+
+static void
+__Connector_dealloc__(Connector *self)
+{
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+    if (self->ios) {
+        PyMem_Free(self->ios);
+        self->ios = NULL;
+    }
+    if (self->addresses) {
+        PyMem_Free(self->addresses);
+        self->addresses = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Connector_Type.tp_dealloc */
+static void
+Connector_tp_dealloc(Connector *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __Watcher_clear__((Watcher *)self);
+    __Connector_dealloc__(self);
+}
+
+
+/* Connector_Type.tp_init */
+static int
+Connector_tp_init(Connector *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "addresses", "timeout",
+        "callback", "data", "priority",
+        "delay", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *addresses = NULL;
+    double timeout = 0.0, delay = __CONNECTOR_DELAY__;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OdO|Oi$d:__init__", kwlist,
+            &Loop_Type, &loop,
+            &addresses, &timeout,
+            &callback, &data, &priority,
+            &delay
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority)
+    ) {
+        return -1;
+    }
+    if (timeout <= 0.0) {
+        PyErr_SetString(PyExc_ValueError, "a positive timeout is required");
+        return -1;
+    }
+    if (delay < 0.0) {
+        PyErr_SetString(PyExc_ValueError, "a positive delay is required");
+        return -1;
+    }
+    __Connector_drop__(self);
+    self->timeout = timeout;
+    self->delay = delay;
+    self->error = 0;
+    return __Connector_set__(self, addresses);
+}
+
+
+/* Connector_Type.tp_new */
+static PyObject *
+Connector_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    Connector *self = NULL;
+
+    if ((self = __Connector_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__Connector_post_alloc__(self, EV_TIMER, sizeof(ev_timer))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Connector_Type.tp_finalize */
+static void
+Connector_tp_finalize(Connector *self)
+{
+    __Connector_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Connector.start() */
+static PyObject *
+Connector_start(Connector *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (!self->count) {
+        PyErr_SetString(EventError, "cannot start an uninitialized Connector");
+        return NULL;
+    }
+    if (!ev_is_active(watcher->watcher)) {
+        __Connector_drop__(self);
+        self->next = 0;
+        self->error = 0;
+        self->expiry = ev_now(watcher->loop->loop) + self->timeout;
+        __Connector_advance__(self);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Connector.stop() */
+static PyObject *
+Connector_stop(Connector *self)
+{
+    if (self->count) {
+        __Connector_stop__(self);
+        __Connector_drop__(self);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Connector_Type.tp_methods */
+static PyMethodDef Connector_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)Connector_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)Connector_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Connector.timeout */
+static PyObject *
+Connector_timeout_getter(Connector *self, void *closure)
+{
+    return PyFloat_FromDouble(self->timeout);
+}
+
+
+/* Connector.delay */
+static PyObject *
+Connector_delay_getter(Connector *self, void *closure)
+{
+    return PyFloat_FromDouble(self->delay);
+}
+
+static int
+Connector_delay_setter(Connector *self, PyObject *value, void *closure)
+{
+    double delay = -1.0;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((delay = PyFloat_AsDouble(value)) == -1.0) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (delay < 0.0) {
+        PyErr_SetString(PyExc_ValueError, "a positive delay is required");
+        return -1;
+    }
+    self->delay = delay;
+    return 0;
+}
+
+
+/* Connector.attempts */
+static PyObject *
+Connector_attempts_getter(Connector *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->next);
+}
+
+
+/* Connector.error */
+static PyObject *
+Connector_error_getter(Connector *self, void *closure)
+{
+    return PyLong_FromLong(self->error);
+}
+
+
+/* Connector_Type.tp_getsets */
+static PyGetSetDef Connector_tp_getsets[] = {
+    {
+        "timeout",
+        (getter)Connector_timeout_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "delay",
+        (getter)Connector_delay_getter,
+        (setter)Connector_delay_setter,
+        NULL,
+        NULL
+    },
+    {
+        "attempts",
+        (getter)Connector_attempts_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "error",
+        (getter)Connector_error_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Connector_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Connector",
+    .tp_basicsize = sizeof(Connector),
+    .tp_dealloc = (destructor)Connector_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "Connector(loop, addresses, timeout, callback[, data=None, priority=0, delay=0.25])",
+    .tp_methods = Connector_tp_methods,
+    .tp_getset = Connector_tp_getsets,
+    .tp_init = (initproc)Connector_tp_init,
+    .tp_new = (newfunc)Connector_tp_new,
+    .tp_finalize = (destructor)Connector_tp_finalize,
+};
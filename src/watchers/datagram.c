@@ -0,0 +1,948 @@
+#include "watcher.h"
+
+#include <netinet/udp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+
+/* helpers ------------------------------------------------------------------ */
+
+#define __DATAGRAM_BATCH__ 64
+#define __DATAGRAM_SIZE__ 2048
+#define __DATAGRAM_SIZE_MAX__ 65535
+#define __DATAGRAM_BATCH_MAX__ 1024
+#define __DATAGRAM_SEND_MAX__ 64
+
+#define __DATAGRAM_CONTROL__ CMSG_SPACE(sizeof(int))
+
+
+// ICMP errors reported on the socket do not end it
+#define __datagram_transient__(e) \
+    (((e) == ECONNREFUSED) || ((e) == EHOSTUNREACH) || ((e) == ENETUNREACH))
+
+
+static void
+__Datagram_set_writing__(Datagram *self, int writing)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_io *io = (ev_io *)watcher->watcher;
+    int events = io->events & (EV_READ | EV_WRITE);
+    int wanted = writing ? (events | EV_WRITE) : (events & ~EV_WRITE);
+    int active = ev_is_active(io);
+
+    if (wanted != events) {
+        if (active) {
+            ev_io_stop(watcher->loop->loop, io);
+        }
+        ev_io_modify(io, wanted);
+        if (active) {
+            ev_io_start(watcher->loop->loop, io);
+        }
+    }
+}
+
+
+/* slab --------------------------------------------------------------------- */
+
+static void
+__Datagram_free_retired__(Datagram *self)
+{
+    StreamChunk *chunk = NULL;
+
+    while ((chunk = self->retired)) {
+        self->retired = chunk->next;
+        PyMem_Free(chunk->data);
+        PyMem_Free(chunk);
+    }
+}
+
+
+static void
+__Datagram_free_slab__(Datagram *self)
+{
+    PyMem_Free(self->controls);
+    self->controls = NULL;
+    PyMem_Free(self->addrs);
+    self->addrs = NULL;
+    PyMem_Free(self->iovs);
+    self->iovs = NULL;
+    PyMem_Free(self->msgs);
+    self->msgs = NULL;
+    PyMem_Free(self->slab);
+    self->slab = NULL;
+}
+
+
+// received datagrams still exported, keep the slab until they are released
+static int
+__Datagram_retire__(Datagram *self)
+{
+    StreamChunk *chunk = NULL;
+
+    if (!(chunk = PyMem_Malloc(sizeof(StreamChunk)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    chunk->data = self->slab;
+    chunk->next = self->retired;
+    self->retired = chunk;
+    self->slab = NULL;
+    return 0;
+}
+
+
+static int
+__Datagram_setup_slab__(Datagram *self)
+{
+    size_t batch = self->batch, size = self->size;
+
+    if (self->exports && self->slab && __Datagram_retire__(self)) {
+        return -1;
+    }
+    if (self->resize) {
+        __Datagram_free_slab__(self);
+        self->resize = 0;
+    }
+    if (
+        (!self->slab && !(self->slab = PyMem_Malloc(batch * size))) ||
+        (
+            !self->msgs &&
+            (
+                !(self->msgs = PyMem_Calloc(batch, sizeof(struct mmsghdr))) ||
+                !(self->iovs = PyMem_Calloc(batch, sizeof(struct iovec))) ||
+                !(self->addrs = PyMem_Calloc(
+                    batch, sizeof(struct sockaddr_storage)
+                )) ||
+                !(self->controls = PyMem_Calloc(batch, __DATAGRAM_CONTROL__))
+            )
+        )
+    ) {
+        __Datagram_free_slab__(self);
+        PyErr_NoMemory();
+        return -1;
+    }
+    return 0;
+}
+
+
+/* receive ------------------------------------------------------------------ */
+
+static int
+__Datagram_gso_size__(struct msghdr *hdr)
+{
+    struct cmsghdr *cmsg = NULL;
+    int size = 0;
+
+    for (cmsg = CMSG_FIRSTHDR(hdr); cmsg; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if ((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)) {
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+        }
+    }
+    return size;
+}
+
+
+static int
+__Datagram_append__(
+    Datagram *self, PyObject *datagrams, char *data, Py_ssize_t len,
+    PyObject *address
+)
+{
+    PyObject *frame = NULL, *item = NULL;
+    int result = -1;
+
+    self->frame = data;
+    self->frame_len = len;
+    // exported through Datagram_bf_getbuffer
+    frame = PyMemoryView_FromObject((PyObject *)self);
+    self->frame = NULL;
+    if (frame && (item = PyTuple_Pack(2, frame, address))) {
+        result = PyList_Append(datagrams, item);
+    }
+    Py_XDECREF(item);
+    Py_XDECREF(frame);
+    return result;
+}
+
+
+static PyObject *
+__Datagram_message__(Datagram *self, PyObject *datagrams, int i)
+{
+    struct msghdr *hdr = &self->msgs[i].msg_hdr;
+    char *data = self->iovs[i].iov_base;
+    Py_ssize_t len = self->msgs[i].msg_len, segment = len;
+    PyObject *address = NULL;
+
+    if (hdr->msg_namelen) {
+        address = __Io_address__(hdr->msg_name, hdr->msg_namelen);
+    }
+    else {
+        address = Py_NewRef(Py_None);
+    }
+    if (!address) {
+        return NULL;
+    }
+    // coalesced by the kernel (UDP_GRO), split them back
+    if (self->gro && (segment = __Datagram_gso_size__(hdr)) <= 0) {
+        segment = len;
+    }
+    // empty datagrams are valid
+    do {
+        if (
+            __Datagram_append__(
+                self, datagrams, data, Py_MIN(len, segment), address
+            )
+        ) {
+            Py_DECREF(address);
+            return NULL;
+        }
+        data += segment;
+        len -= segment;
+    } while (len > 0);
+    Py_DECREF(address);
+    return datagrams;
+}
+
+
+// *done is set to 1 if recvmmsg() failed (see self->error)
+static PyObject *
+__Datagram_recv__(Datagram *self, int *done)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd, i, n = 0;
+    struct msghdr *hdr = NULL;
+    PyObject *datagrams = NULL;
+
+    if (__Datagram_setup_slab__(self) || !(datagrams = PyList_New(0))) {
+        return NULL;
+    }
+    for (i = 0; i < self->batch; i++) {
+        self->iovs[i].iov_base = self->slab + ((size_t)i * self->size);
+        self->iovs[i].iov_len = self->size;
+        hdr = &self->msgs[i].msg_hdr;
+        hdr->msg_name = &self->addrs[i];
+        hdr->msg_namelen = sizeof(struct sockaddr_storage);
+        hdr->msg_iov = &self->iovs[i];
+        hdr->msg_iovlen = 1;
+        hdr->msg_control = self->gro ?
+            (self->controls + ((size_t)i * __DATAGRAM_CONTROL__)) : NULL;
+        hdr->msg_controllen = self->gro ? __DATAGRAM_CONTROL__ : 0;
+        hdr->msg_flags = 0;
+    }
+    while (
+        (n = recvmmsg(fd, self->msgs, self->batch, MSG_DONTWAIT, NULL)) < 0
+    ) {
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            self->error = errno;
+            *done = !__datagram_transient__(errno);
+        }
+        return datagrams;
+    }
+    for (i = 0; i < n; i++) {
+        if (self->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            // larger than size, do not pass it as complete
+            self->truncated++;
+            continue;
+        }
+        if (!__Datagram_message__(self, datagrams, i)) {
+            Py_CLEAR(datagrams);
+            break;
+        }
+    }
+    return datagrams;
+}
+
+
+/* send --------------------------------------------------------------------- */
+
+static int
+__Datagram_push__(Datagram *self, DatagramMessage *message)
+{
+    DatagramMessage *sends = self->sends;
+    Py_ssize_t size = self->sends_size;
+
+    if (self->sends_len == size) {
+        if (self->sends_head) {
+            self->sends_len -= self->sends_head;
+            memmove(
+                sends,
+                sends + self->sends_head,
+                self->sends_len * sizeof(DatagramMessage)
+            );
+            self->sends_head = 0;
+        }
+        else {
+            size = size ? (size * 2) : 16;
+            if (!PyMem_Resize(sends, DatagramMessage, size)) {
+                PyErr_NoMemory();
+                return -1;
+            }
+            self->sends = sends;
+            self->sends_size = size;
+        }
+    }
+    self->sends[self->sends_len++] = *message;
+    self->buffered += message->view.len;
+    return 0;
+}
+
+
+static void
+__Datagram_consume__(Datagram *self, Py_ssize_t count)
+{
+    DatagramMessage *message = NULL;
+
+    for (; count; count--) {
+        message = &self->sends[self->sends_head++];
+        self->buffered -= message->view.len;
+        PyBuffer_Release(&message->view);
+    }
+    if (self->sends_head == self->sends_len) {
+        self->sends_head = self->sends_len = 0;
+    }
+}
+
+
+static void
+__Datagram_clear_sends__(Datagram *self)
+{
+    __Datagram_consume__(self, self->sends_len - self->sends_head);
+}
+
+
+static void
+__Datagram_set_segment__(
+    Datagram *self, struct msghdr *hdr, char *control, Py_ssize_t len
+)
+{
+    struct cmsghdr *cmsg = NULL;
+    uint16_t segment = (uint16_t)self->segment;
+
+    if (!segment || (len <= segment)) {
+        hdr->msg_control = NULL;
+        hdr->msg_controllen = 0;
+        return;
+    }
+    // split by the kernel (UDP_SEGMENT)
+    hdr->msg_control = control;
+    hdr->msg_controllen = CMSG_SPACE(sizeof(segment));
+    cmsg = CMSG_FIRSTHDR(hdr);
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(segment));
+    memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+}
+
+
+// one sendmmsg per round
+static void
+__Datagram_flush__(Datagram *self)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd, i, count, n;
+    struct mmsghdr msgs[__DATAGRAM_SEND_MAX__];
+    struct iovec iovs[__DATAGRAM_SEND_MAX__];
+    char controls[__DATAGRAM_SEND_MAX__][CMSG_SPACE(sizeof(uint16_t))];
+    DatagramMessage *message = NULL;
+    struct msghdr *hdr = NULL;
+
+    memset(msgs, 0, sizeof(msgs));
+    memset(controls, 0, sizeof(controls));
+    while (self->sends_len) {
+        count = (int)Py_MIN(
+            self->sends_len - self->sends_head, __DATAGRAM_SEND_MAX__
+        );
+        for (i = 0; i < count; i++) {
+            message = &self->sends[self->sends_head + i];
+            iovs[i].iov_base = message->view.buf;
+            iovs[i].iov_len = message->view.len;
+            hdr = &msgs[i].msg_hdr;
+            hdr->msg_name = message->addrlen ? &message->addr : NULL;
+            hdr->msg_namelen = message->addrlen;
+            hdr->msg_iov = &iovs[i];
+            hdr->msg_iovlen = 1;
+            __Datagram_set_segment__(
+                self, hdr, controls[i], message->view.len
+            );
+        }
+        if ((n = sendmmsg(fd, msgs, count, MSG_DONTWAIT)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            // datagrams are unreliable anyway, drop it and go on
+            self->error = errno;
+            n = 1;
+        }
+        __Datagram_consume__(self, n);
+        if (n < count) {
+            break; // fd is full
+        }
+    }
+    __Datagram_set_writing__(self, (self->sends_len != 0));
+}
+
+
+static void
+__ev_datagram_flush__(ev_loop *loop, ev_prepare *prepare, int revents)
+{
+    ev_prepare_stop(loop, prepare);
+    __Datagram_flush__(prepare->data);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static void
+__ev_datagram_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    Watcher *self = io->data;
+    PyObject *datagrams = NULL;
+    int done = 0;
+
+    if ((revents & EV_ERROR) || self->loop->collecting) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)io, revents);
+        return;
+    }
+    if (__Watcher_invoke_verify__(self)) {
+        goto end;
+    }
+    if (revents & EV_WRITE) {
+        __Datagram_flush__((Datagram *)self);
+    }
+    if (
+        (revents & EV_READ) &&
+        (datagrams = __Datagram_recv__((Datagram *)self, &done))
+    ) {
+        if ((self->callback != Py_None) && PyList_GET_SIZE(datagrams)) {
+            __Watcher_invoke_callback__(self, datagrams);
+        }
+        Py_DECREF(datagrams);
+        if (done) {
+            ev_prepare_stop(loop, ((Datagram *)self)->prepare);
+            __ev_watcher_stop__(loop, self->watcher, self->ev_type);
+            __Datagram_clear_sends__((Datagram *)self);
+            __Datagram_set_writing__((Datagram *)self, 0);
+            if (!PyErr_Occurred() && (self->callback != Py_None)) {
+                __Watcher_invoke_callback__(self, Py_None);
+            }
+        }
+    }
+
+end:
+    if (
+        PyErr_Occurred() ||
+        (!self->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   Datagram
+   -------------------------------------------------------------------------- */
+
+static Datagram *
+__Datagram_alloc__(PyTypeObject *type)
+{
+    Datagram *self = NULL;
+
+    if ((self = (Datagram *)__Watcher_alloc__(type))) {
+        self->family = AF_UNSPEC;
+        self->batch = __DATAGRAM_BATCH__;
+        self->size = __DATAGRAM_SIZE__;
+        self->gro = 0;
+        self->segment = 0;
+        self->resize = 0;
+        self->slab = NULL;
+        self->msgs = NULL;
+        self->iovs = NULL;
+        self->addrs = NULL;
+        self->controls = NULL;
+        self->frame = NULL;
+        self->frame_len = 0;
+        self->exports = 0;
+        self->retired = NULL;
+        self->prepare = NULL;
+        self->sends = NULL;
+        self->sends_head = 0;
+        self->sends_len = 0;
+        self->sends_size = 0;
+        self->buffered = 0;
+        self->truncated = 0;
+        self->error = 0;
+    }
+    return self;
+}
+
+
+static int
+__Datagram_post_alloc__(Datagram *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    if (!(self->prepare = PyMem_Malloc(sizeof(ev_prepare)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->prepare->data = self;
+    ev_prepare_init(self->prepare, __ev_datagram_flush__);
+    ev_set_cb(((ev_io *)watcher->watcher), __ev_datagram_invoke__);
+    return 0;
+}
+
+
+static void
+__Datagram_finalize__(Datagram *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (self->prepare && watcher->loop && watcher->loop->loop) {
+        ev_prepare_stop(watcher->loop->loop, self->prepare);
+    }
+    __Watcher_finalize__(watcher);
+}
+
+
+static int
+__Datagram_traverse__(Datagram *self, visitproc visit, void *arg)
+{
+    Py_ssize_t i;
+
+    for (i = self->sends_head; i < self->sends_len; i++) {
+        Py_VISIT(self->sends[i].view.obj);
+    }
+    return __Watcher_traverse__((Watcher *)self, visit, arg);
+}
+
+
+static int
+__Datagram_clear__(Datagram *self)
+{
+    __Datagram_clear_sends__(self);
+    return __Watcher_clear__((Watcher *)self);
+}
+
+
+static void
+__Datagram_dealloc__(Datagram *self)
+{
+    // no datagram can be exported anymore
+    __Datagram_free_retired__(self);
+    __Datagram_free_slab__(self);
+    if (self->sends) {
+        PyMem_Free(self->sends);
+        self->sends = NULL;
+    }
+    if (self->prepare) {
+        PyMem_Free(self->prepare);
+        self->prepare = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static int
+__Datagram_set_family__(Datagram *self)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd;
+    socklen_t len = sizeof(self->family);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &self->family, &len)) {
+        _PyErr_SetFromErrno();
+        return -1;
+    }
+    return 0;
+}
+
+
+static int
+__Datagram_set_option__(Datagram *self, int option, int value)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd;
+
+    if (setsockopt(fd, SOL_UDP, option, &value, sizeof(value))) {
+        _PyErr_SetFromErrno();
+        return -1;
+    }
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Datagram_Type.tp_dealloc */
+static void
+Datagram_tp_dealloc(Datagram *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __Datagram_clear__(self);
+    __Datagram_dealloc__(self);
+}
+
+
+/* Datagram_Type.tp_traverse */
+static int
+Datagram_tp_traverse(Datagram *self, visitproc visit, void *arg)
+{
+    return __Datagram_traverse__(self, visit, arg);
+}
+
+
+/* Datagram_Type.tp_clear */
+static int
+Datagram_tp_clear(Datagram *self)
+{
+    return __Datagram_clear__(self);
+}
+
+
+/* Datagram_Type.tp_init */
+static int
+Datagram_tp_init(Datagram *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd",
+        "callback", "data", "priority", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *fd = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OO|Oi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd,
+            &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, EV_READ)
+    ) {
+        return -1;
+    }
+    return __Datagram_set_family__(self);
+}
+
+
+/* Datagram_Type.tp_new */
+static PyObject *
+Datagram_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    Datagram *self = NULL;
+
+    if ((self = __Datagram_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__Datagram_post_alloc__(self, EV_IO, sizeof(ev_io))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Datagram_Type.tp_finalize */
+static void
+Datagram_tp_finalize(Datagram *self)
+{
+    __Datagram_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Datagram_Type.tp_as_buffer.bf_getbuffer */
+static int
+Datagram_bf_getbuffer(Datagram *self, Py_buffer *view, int flags)
+{
+    if (!self->frame) {
+        PyErr_SetString(PyExc_BufferError, "no current datagram");
+        view->obj = NULL;
+        return -1;
+    }
+    if (
+        PyBuffer_FillInfo(
+            view, (PyObject *)self, self->frame, self->frame_len, 1, flags
+        )
+    ) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+
+/* Datagram_Type.tp_as_buffer.bf_releasebuffer */
+static void
+Datagram_bf_releasebuffer(Datagram *self, Py_buffer *view)
+{
+    if (!--self->exports) {
+        __Datagram_free_retired__(self);
+    }
+}
+
+
+static PyBufferProcs Datagram_tp_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Datagram_bf_getbuffer,
+    .bf_releasebuffer = (releasebufferproc)Datagram_bf_releasebuffer,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Datagram.send(buf[, address=None]) */
+static PyObject *
+Datagram_send(Datagram *self, PyObject *args)
+{
+    Watcher *watcher = (Watcher *)self;
+    PyObject *address = Py_None;
+    DatagramMessage message;
+
+    message.addrlen = 0;
+    if (!PyArg_ParseTuple(args, "y*|O:send", &message.view, &address)) {
+        return NULL;
+    }
+    if (
+        (
+            (address != Py_None) &&
+            __Io_sockaddr__(
+                self->family, address, &message.addr, &message.addrlen
+            )
+        ) ||
+        __Datagram_push__(self, &message)
+    ) {
+        PyBuffer_Release(&message.view);
+        return NULL;
+    }
+    // flushed at the end of this loop iteration (or when fd is writable)
+    if (!(((ev_io *)watcher->watcher)->events & EV_WRITE)) {
+        ev_prepare_start(watcher->loop->loop, self->prepare);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Datagram_Type.tp_methods */
+static PyMethodDef Datagram_tp_methods[] = {
+    {
+        "send",
+        (PyCFunction)Datagram_send,
+        METH_VARARGS,
+        "send(buf[, address=None])"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Datagram.batch/Datagram.size */
+static PyObject *
+Datagram_size_getter(Datagram *self, void *closure)
+{
+    return PyLong_FromLong(closure ? self->size : self->batch);
+}
+
+static int
+Datagram_size_setter(Datagram *self, PyObject *value, void *closure)
+{
+    int size = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((size = _PyLong_AsInt(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (
+        (size <= 0) ||
+        (
+            closure ?
+            (size > __DATAGRAM_SIZE_MAX__) :
+            (size > __DATAGRAM_BATCH_MAX__)
+        )
+    ) {
+        PyErr_SetString(PyExc_ValueError, "size out of range");
+        return -1;
+    }
+    if (closure && self->gro && (size < __DATAGRAM_SIZE_MAX__)) {
+        // coalesced datagrams can be up to 64KiB
+        PyErr_SetString(PyExc_ValueError, "size must be 65535 with gro");
+        return -1;
+    }
+    if (closure) {
+        self->size = size;
+    }
+    else {
+        self->batch = size;
+    }
+    // reallocated on next receive
+    self->resize = 1;
+    return 0;
+}
+
+
+/* Datagram.gro */
+static PyObject *
+Datagram_gro_getter(Datagram *self, void *closure)
+{
+    return PyBool_FromLong(self->gro);
+}
+
+static int
+Datagram_gro_setter(Datagram *self, PyObject *value, void *closure)
+{
+    int gro = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (
+        ((gro = PyObject_IsTrue(value)) < 0) ||
+        __Datagram_set_option__(self, UDP_GRO, gro)
+    ) {
+        return -1;
+    }
+    if ((self->gro = gro) && (self->size < __DATAGRAM_SIZE_MAX__)) {
+        // coalesced datagrams can be up to 64KiB
+        self->size = __DATAGRAM_SIZE_MAX__;
+        self->resize = 1;
+    }
+    return 0;
+}
+
+
+/* Datagram.segment */
+static PyObject *
+Datagram_segment_getter(Datagram *self, void *closure)
+{
+    return PyLong_FromLong(self->segment);
+}
+
+static int
+Datagram_segment_setter(Datagram *self, PyObject *value, void *closure)
+{
+    int segment = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((segment = _PyLong_AsInt(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if ((segment < 0) || (segment > UINT16_MAX)) {
+        PyErr_SetString(PyExc_ValueError, "segment out of range");
+        return -1;
+    }
+    self->segment = segment;
+    return 0;
+}
+
+
+/* Datagram.buffered */
+static PyObject *
+Datagram_buffered_getter(Datagram *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->buffered);
+}
+
+
+/* Datagram.truncated */
+static PyObject *
+Datagram_truncated_getter(Datagram *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->truncated);
+}
+
+
+/* Datagram.error */
+static PyObject *
+Datagram_error_getter(Datagram *self, void *closure)
+{
+    return PyLong_FromLong(self->error);
+}
+
+
+/* Datagram_Type.tp_getsets */
+static PyGetSetDef Datagram_tp_getsets[] = {
+    {
+        "batch",
+        (getter)Datagram_size_getter,
+        (setter)Datagram_size_setter,
+        NULL,
+        NULL
+    },
+    {
+        "size",
+        (getter)Datagram_size_getter,
+        (setter)Datagram_size_setter,
+        NULL,
+        Py_True
+    },
+    {
+        "gro",
+        (getter)Datagram_gro_getter,
+        (setter)Datagram_gro_setter,
+        NULL,
+        NULL
+    },
+    {
+        "segment",
+        (getter)Datagram_segment_getter,
+        (setter)Datagram_segment_setter,
+        NULL,
+        NULL
+    },
+    {
+        "buffered",
+        (getter)Datagram_buffered_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "truncated",
+        (getter)Datagram_truncated_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "error",
+        (getter)Datagram_error_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Datagram_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Datagram",
+    .tp_basicsize = sizeof(Datagram),
+    .tp_dealloc = (destructor)Datagram_tp_dealloc,
+    .tp_as_buffer = &Datagram_tp_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "Datagram(loop, fd, callback[, data=None, priority=0])",
+    .tp_traverse = (traverseproc)Datagram_tp_traverse,
+    .tp_clear = (inquiry)Datagram_tp_clear,
+    .tp_methods = Datagram_tp_methods,
+    .tp_getset = Datagram_tp_getsets,
+    .tp_init = (initproc)Datagram_tp_init,
+    .tp_new = (newfunc)Datagram_tp_new,
+    .tp_finalize = (destructor)Datagram_tp_finalize,
+};
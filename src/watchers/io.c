@@ -1,5 +1,11 @@
 #include "watcher.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 
 /* helpers ------------------------------------------------------------------ */
 
@@ -18,7 +24,7 @@ __ev_io_check_events__(int events)
    Io
    -------------------------------------------------------------------------- */
 
-static int
+int
 __Io_set__(Watcher *self, PyObject *fd, int events)
 {
     int fdnum = PyObject_AsFileDescriptor(fd);
@@ -27,10 +33,148 @@ __Io_set__(Watcher *self, PyObject *fd, int events)
         return -1;
     }
     ev_io_set(((ev_io *)self->watcher), fdnum, events);
+#ifdef SO_BUSY_POLL
+    if (self->loop->busy_poll_sockets && self->loop->busy_poll) {
+        int busy_poll = (int)Py_MIN(self->loop->busy_poll, INT_MAX);
+
+        // best effort, fd might not be a socket
+        setsockopt(
+            fdnum, SOL_SOCKET, SO_BUSY_POLL, &busy_poll, sizeof(busy_poll)
+        );
+    }
+#endif
     return 0;
 }
 
 
+// same format as the socket module
+PyObject *
+__Io_address__(const struct sockaddr *addr, size_t len)
+{
+    char host[INET6_ADDRSTRLEN];
+    const struct sockaddr_in *in = NULL;
+    const struct sockaddr_in6 *in6 = NULL;
+    const struct sockaddr_un *un = NULL;
+    Py_ssize_t size = 0;
+
+    switch (addr->sa_family) {
+        case AF_INET:
+            in = (const struct sockaddr_in *)addr;
+            inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+            return Py_BuildValue("si", host, ntohs(in->sin_port));
+        case AF_INET6:
+            in6 = (const struct sockaddr_in6 *)addr;
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            return Py_BuildValue(
+                "siII",
+                host,
+                ntohs(in6->sin6_port),
+                ntohl(in6->sin6_flowinfo),
+                in6->sin6_scope_id
+            );
+        case AF_UNIX:
+            un = (const struct sockaddr_un *)addr;
+            size = len - offsetof(struct sockaddr_un, sun_path);
+            if ((size > 0) && !un->sun_path[0]) { // abstract namespace
+                return PyBytes_FromStringAndSize(un->sun_path, size);
+            }
+            return PyUnicode_DecodeFSDefaultAndSize(
+                un->sun_path, (size > 0) ? strnlen(un->sun_path, size) : 0
+            );
+        default:
+            Py_RETURN_NONE;
+    }
+}
+
+
+// numeric addresses only, no name resolution here
+int
+__Io_sockaddr__(
+    int family,
+    PyObject *address,
+    struct sockaddr_storage *addr,
+    socklen_t *len
+)
+{
+    struct sockaddr_in *in = (struct sockaddr_in *)addr;
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+    struct sockaddr_un *un = (struct sockaddr_un *)addr;
+    const char *host = NULL;
+    int port = 0, result = -1;
+    unsigned int flowinfo = 0, scope_id = 0;
+    PyObject *path = NULL;
+    Py_ssize_t size = 0;
+
+    memset(addr, 0, sizeof(*addr));
+    if (
+        ((family == AF_INET) || (family == AF_INET6)) &&
+        !PyTuple_Check(address)
+    ) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "address must be a tuple, not %.200s",
+            Py_TYPE(address)->tp_name
+        );
+        return -1;
+    }
+    switch (family) {
+        case AF_INET:
+            if (!PyArg_ParseTuple(address, "si:address", &host, &port)) {
+                return -1;
+            }
+            if (inet_pton(AF_INET, host, &in->sin_addr) != 1) {
+                break;
+            }
+            in->sin_family = AF_INET;
+            in->sin_port = htons((uint16_t)port);
+            *len = sizeof(*in);
+            result = 0;
+            break;
+        case AF_INET6:
+            if (
+                !PyArg_ParseTuple(
+                    address, "si|II:address",
+                    &host, &port, &flowinfo, &scope_id
+                )
+            ) {
+                return -1;
+            }
+            if (inet_pton(AF_INET6, host, &in6->sin6_addr) != 1) {
+                break;
+            }
+            in6->sin6_family = AF_INET6;
+            in6->sin6_port = htons((uint16_t)port);
+            in6->sin6_flowinfo = htonl(flowinfo);
+            in6->sin6_scope_id = scope_id;
+            *len = sizeof(*in6);
+            result = 0;
+            break;
+        case AF_UNIX:
+            if (!PyUnicode_FSConverter(address, &path)) {
+                return -1;
+            }
+            size = PyBytes_GET_SIZE(path);
+            if (size < (Py_ssize_t)sizeof(un->sun_path)) {
+                memcpy(un->sun_path, PyBytes_AS_STRING(path), size);
+                un->sun_family = AF_UNIX;
+                // abstract addresses are not NUL terminated
+                *len = offsetof(struct sockaddr_un, sun_path) + size +
+                       (size && un->sun_path[0]);
+                result = 0;
+            }
+            Py_DECREF(path);
+            break;
+        default:
+            PyErr_SetString(EventError, "unsupported address family");
+            return -1;
+    }
+    if (result) {
+        PyErr_Format(PyExc_ValueError, "invalid address: %R", address);
+    }
+    return result;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /* Io_Type.tp_init */
@@ -0,0 +1,727 @@
+#include "watcher.h"
+
+
+#if EV_ASYNC_ENABLE
+
+
+/* helpers ------------------------------------------------------------------ */
+
+// entries never move once allocated (libev keeps pointers to them)
+#define __IOMUX_PAGE_SIZE__ 1024
+
+#define __IoMux_page__(fd) ((fd) / __IOMUX_PAGE_SIZE__)
+#define __IoMux_slot__(fd) ((fd) % __IOMUX_PAGE_SIZE__)
+
+
+static int
+__IoMux_check_events__(int events)
+{
+    if (!events || (events & ~(EV_READ | EV_WRITE))) {
+        PyErr_SetString(EventError, "illegal event mask");
+        return -1;
+    }
+    return 0;
+}
+
+
+static IoMuxEntry *
+__IoMux_entry__(IoMux *self, int fd)
+{
+    IoMuxEntry *page = NULL;
+
+    if (
+        (fd >= 0) &&
+        (__IoMux_page__(fd) < self->npages) &&
+        (page = self->pages[__IoMux_page__(fd)]) &&
+        (page[__IoMux_slot__(fd)].io.fd == fd)
+    ) {
+        return &page[__IoMux_slot__(fd)];
+    }
+    return NULL;
+}
+
+
+static IoMuxEntry *
+__IoMux_lookup__(IoMux *self, PyObject *fd, int *fdnum)
+{
+    IoMuxEntry *entry = NULL;
+
+    if ((*fdnum = PyObject_AsFileDescriptor(fd)) < 0) {
+        return NULL;
+    }
+    if (!(entry = __IoMux_entry__(self, *fdnum))) {
+        PyErr_Format(PyExc_KeyError, "%d is not registered", *fdnum);
+    }
+    return entry;
+}
+
+
+// drop the events collected for this entry but not dispatched yet
+static void
+__IoMux_discard__(IoMux *self, IoMuxEntry *entry)
+{
+    Py_ssize_t i;
+
+    if (entry->revents) {
+        entry->revents = 0;
+        for (i = 0; i < self->ready_len; i++) {
+            if (self->ready[i] == entry->io.fd) {
+                memmove(
+                    &self->ready[i], &self->ready[i + 1],
+                    (--self->ready_len - i) * sizeof(int)
+                );
+                break;
+            }
+        }
+    }
+}
+
+
+static void
+__IoMux_modify__(ev_loop *loop, ev_io *io, int events)
+{
+    if (ev_is_active(io)) {
+        ev_io_stop(loop, io);
+        ev_io_modify(io, events);
+        ev_io_start(loop, io);
+    }
+    else {
+        ev_io_modify(io, events);
+    }
+}
+
+
+// fd watchers only record their events, dispatching is left to the mux
+static void
+__ev_iomux_io_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    IoMuxEntry *entry = (IoMuxEntry *)io;
+    IoMux *self = io->data;
+    Watcher *watcher = (Watcher *)self;
+
+    if (!entry->revents) {
+        self->ready[self->ready_len++] = io->fd;
+    }
+    entry->revents |= revents;
+    // fd watchers run at EV_MAXPRI, a mux with a lower priority is invoked
+    // once all of them have run
+    if (!ev_is_pending(watcher->watcher) && !watcher->queued) {
+        ev_feed_event(loop, watcher->watcher, EV_CUSTOM);
+    }
+}
+
+
+// returns a list of (fd, revents) tuples
+static PyObject *
+__IoMux_collect__(IoMux *self)
+{
+    PyObject *events = NULL, *item = NULL;
+    IoMuxEntry *entry = NULL;
+    Py_ssize_t i;
+
+    events = PyList_New(0);
+    for (i = 0; i < self->ready_len; i++) {
+        if ((entry = __IoMux_entry__(self, self->ready[i]))) {
+            if (events) {
+                if (
+                    !(item = Py_BuildValue(
+                        "(ii)", entry->io.fd, entry->revents
+                    )) ||
+                    PyList_Append(events, item)
+                ) {
+                    Py_CLEAR(events);
+                }
+                Py_XDECREF(item);
+            }
+            entry->revents = 0;
+        }
+    }
+    self->ready_len = 0;
+    return events;
+}
+
+
+static void
+__ev_iomux_invoke__(ev_loop *loop, ev_async *async, int revents)
+{
+    IoMux *self = async->data;
+    Watcher *watcher = (Watcher *)self;
+    PyObject *events = NULL, *item = NULL;
+    Py_ssize_t i;
+
+    if ((revents & EV_ERROR) || watcher->loop->collecting) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)async, revents);
+        return;
+    }
+    if (
+        !__Watcher_invoke_verify__(watcher) &&
+        (events = __IoMux_collect__(self))
+    ) {
+        if (watcher->callback == Py_None) {
+            // nobody to hand them to, they are simply dropped
+        }
+        else if (self->batch) {
+            if (PyList_GET_SIZE(events)) {
+                __Watcher_invoke_callback__(watcher, events);
+            }
+        }
+        else {
+            for (i = 0; i < PyList_GET_SIZE(events); i++) {
+                item = PyList_GET_ITEM(events, i);
+                // a previous call might have removed it
+                if (
+                    __IoMux_entry__(
+                        self, (int)PyLong_AsLong(PyTuple_GET_ITEM(item, 0))
+                    )
+                ) {
+                    __Watcher_invoke_callback__(watcher, item);
+                    if (PyErr_Occurred()) {
+                        break;
+                    }
+                }
+            }
+        }
+        Py_DECREF(events);
+    }
+    if (
+        PyErr_Occurred() ||
+        (!watcher->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static IoMuxEntry *
+__IoMux_page_new__(IoMux *self)
+{
+    IoMuxEntry *page = NULL;
+    int i;
+
+    if (!(page = PyMem_New(IoMuxEntry, __IOMUX_PAGE_SIZE__))) {
+        PyErr_NoMemory();
+        return NULL;
+    }
+    for (i = 0; i < __IOMUX_PAGE_SIZE__; i++) {
+        ev_io_init(&page[i].io, __ev_iomux_io_invoke__, -1, 0);
+        ev_set_priority(&page[i].io, EV_MAXPRI);
+        page[i].io.data = self;
+        page[i].data = NULL;
+        page[i].revents = 0;
+    }
+    return page;
+}
+
+
+// makes room for one more entry, returns its (unregistered) slot
+static IoMuxEntry *
+__IoMux_reserve__(IoMux *self, int fd)
+{
+    Py_ssize_t npages = __IoMux_page__(fd) + 1, size = self->count + 1, i;
+    IoMuxEntry **pages = NULL;
+    int *ready = NULL;
+
+    if (npages > self->npages) {
+        if (!(pages = PyMem_Realloc(self->pages, npages * sizeof(*pages)))) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        for (i = self->npages; i < npages; i++) {
+            pages[i] = NULL;
+        }
+        self->pages = pages;
+        self->npages = npages;
+    }
+    if (
+        !self->pages[__IoMux_page__(fd)] &&
+        !(self->pages[__IoMux_page__(fd)] = __IoMux_page_new__(self))
+    ) {
+        return NULL;
+    }
+    if (size > self->ready_size) {
+        size = Py_MAX(size, 2 * self->ready_size);
+        if (!(ready = PyMem_Realloc(self->ready, size * sizeof(int)))) {
+            PyErr_NoMemory();
+            return NULL;
+        }
+        self->ready = ready;
+        self->ready_size = size;
+    }
+    return &self->pages[__IoMux_page__(fd)][__IoMux_slot__(fd)];
+}
+
+
+static void
+__IoMux_stop__(IoMux *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_loop *loop = watcher->loop->loop;
+    IoMuxEntry *page = NULL;
+    Py_ssize_t i, j;
+
+    if (ev_is_active(watcher->watcher)) {
+        ev_ref(loop);
+        ev_async_stop(loop, (ev_async *)watcher->watcher);
+    }
+    for (i = 0; i < self->npages; i++) {
+        if ((page = self->pages[i])) {
+            for (j = 0; j < __IOMUX_PAGE_SIZE__; j++) {
+                ev_io_stop(loop, &page[j].io);
+                page[j].revents = 0;
+            }
+        }
+    }
+    self->ready_len = 0;
+    watcher->queued = 0;
+}
+
+
+/* --------------------------------------------------------------------------
+   IoMux
+   -------------------------------------------------------------------------- */
+
+static IoMux *
+__IoMux_alloc__(PyTypeObject *type)
+{
+    IoMux *self = NULL;
+
+    if ((self = (IoMux *)__Watcher_alloc__(type))) {
+        self->pages = NULL;
+        self->npages = 0;
+        self->count = 0;
+        self->ready = NULL;
+        self->ready_len = 0;
+        self->ready_size = 0;
+        self->batch = 0;
+    }
+    return self;
+}
+
+
+static int
+__IoMux_post_alloc__(IoMux *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    ev_set_cb(((ev_async *)watcher->watcher), __ev_iomux_invoke__);
+    return 0;
+}
+
+
+static void
+__IoMux_finalize__(IoMux *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (watcher->watcher && watcher->loop && watcher->loop->loop) {
+        __IoMux_stop__(self);
+    }
+}
+
+
+static int
+__IoMux_traverse__(IoMux *self, visitproc visit, void *arg)
+{
+    IoMuxEntry *page = NULL;
+    Py_ssize_t i, j;
+
+    for (i = 0; i < self->npages; i++) {
+        if ((page = self->pages[i])) {
+            for (j = 0; j < __IOMUX_PAGE_SIZE__; j++) {
+                Py_VISIT(page[j].data);
+            }
+        }
+    }
+    return __Watcher_traverse__((Watcher *)self, visit, arg);
+}
+
+
+static int
+__IoMux_clear__(IoMux *self)
+{
+    IoMuxEntry *page = NULL;
+    Py_ssize_t i, j;
+
+    for (i = 0; i < self->npages; i++) {
+        if ((page = self->pages[i])) {
+            for (j = 0; j < __IOMUX_PAGE_SIZE__; j++) {
+                Py_CLEAR(page[j].data);
+            }
+        }
+    }
+    return __Watcher_clear__((Watcher *)self);
+}
+
+
+static void
+__IoMux_dealloc__(IoMux *self)
+{
+    Py_ssize_t i;
+
+    if (self->pages) {
+        for (i = 0; i < self->npages; i++) {
+            PyMem_Free(self->pages[i]);
+        }
+        PyMem_Free(self->pages);
+        self->pages = NULL;
+    }
+    if (self->ready) {
+        PyMem_Free(self->ready);
+        self->ready = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* IoMux_Type.tp_dealloc */
+static void
+IoMux_tp_dealloc(IoMux *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __IoMux_clear__(self);
+    __IoMux_dealloc__(self);
+}
+
+
+/* IoMux_Type.tp_traverse */
+static int
+IoMux_tp_traverse(IoMux *self, visitproc visit, void *arg)
+{
+    return __IoMux_traverse__(self, visit, arg);
+}
+
+
+/* IoMux_Type.tp_clear */
+static int
+IoMux_tp_clear(IoMux *self)
+{
+    return __IoMux_clear__(self);
+}
+
+
+/* IoMux_Type.tp_init */
+static int
+IoMux_tp_init(IoMux *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "callback", "data", "priority",
+        "batch", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0, batch = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!O|Oi$p:__init__", kwlist,
+            &Loop_Type, &loop,
+            &callback, &data, &priority,
+            &batch
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority)
+    ) {
+        return -1;
+    }
+    self->batch = batch;
+    return 0;
+}
+
+
+/* IoMux_Type.tp_new */
+static PyObject *
+IoMux_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    IoMux *self = NULL;
+
+    if ((self = __IoMux_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__IoMux_post_alloc__(self, EV_ASYNC, sizeof(ev_async))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* IoMux_Type.tp_finalize */
+static void
+IoMux_tp_finalize(IoMux *self)
+{
+    __IoMux_finalize__(self);
+}
+
+
+/* IoMux_Type.tp_as_sequence.sq_length */
+static Py_ssize_t
+IoMux_sq_length(IoMux *self)
+{
+    return self->count;
+}
+
+
+/* IoMux_Type.tp_as_sequence.sq_contains */
+static int
+IoMux_sq_contains(IoMux *self, PyObject *value)
+{
+    int fd = PyObject_AsFileDescriptor(value);
+
+    if (fd < 0) {
+        return -1;
+    }
+    return (__IoMux_entry__(self, fd) != NULL);
+}
+
+
+static PySequenceMethods IoMux_tp_as_sequence = {
+    .sq_length = (lenfunc)IoMux_sq_length,
+    .sq_contains = (objobjproc)IoMux_sq_contains,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* IoMux.start() */
+static PyObject *
+IoMux_start(IoMux *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_loop *loop = watcher->loop->loop;
+    IoMuxEntry *page = NULL;
+    Py_ssize_t i, j;
+
+    if (!ev_is_active(watcher->watcher)) {
+        // only registered fds keep the loop alive
+        ev_async_start(loop, (ev_async *)watcher->watcher);
+        ev_unref(loop);
+        for (i = 0; i < self->npages; i++) {
+            if ((page = self->pages[i])) {
+                for (j = 0; j < __IOMUX_PAGE_SIZE__; j++) {
+                    if (page[j].io.fd >= 0) {
+                        ev_io_start(loop, &page[j].io);
+                    }
+                }
+            }
+        }
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* IoMux.stop() */
+static PyObject *
+IoMux_stop(IoMux *self)
+{
+    __IoMux_stop__(self);
+    Py_RETURN_NONE;
+}
+
+
+/* IoMux.add(fd, events[, data=None]) */
+static PyObject *
+IoMux_add(IoMux *self, PyObject *args)
+{
+    Watcher *watcher = (Watcher *)self;
+    PyObject *fd = NULL, *data = Py_None;
+    IoMuxEntry *entry = NULL;
+    int events = 0, fdnum = -1;
+
+    if (
+        !PyArg_ParseTuple(args, "Oi|O:add", &fd, &events, &data) ||
+        ((fdnum = PyObject_AsFileDescriptor(fd)) < 0) ||
+        __IoMux_check_events__(events)
+    ) {
+        return NULL;
+    }
+    if (__IoMux_entry__(self, fdnum)) {
+        PyErr_Format(PyExc_KeyError, "%d is already registered", fdnum);
+        return NULL;
+    }
+    if (!(entry = __IoMux_reserve__(self, fdnum))) {
+        return NULL;
+    }
+    ev_io_set(&entry->io, fdnum, events);
+    _Py_SET_MEMBER(entry->data, data);
+    entry->revents = 0;
+    self->count++;
+    if (ev_is_active(watcher->watcher)) {
+        ev_io_start(watcher->loop->loop, &entry->io);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* IoMux.modify(fd, events[, data]) */
+static PyObject *
+IoMux_modify(IoMux *self, PyObject *args)
+{
+    Watcher *watcher = (Watcher *)self;
+    PyObject *fd = NULL, *data = NULL;
+    IoMuxEntry *entry = NULL;
+    int events = 0, fdnum = -1;
+
+    if (
+        !PyArg_ParseTuple(args, "Oi|O:modify", &fd, &events, &data) ||
+        __IoMux_check_events__(events) ||
+        !(entry = __IoMux_lookup__(self, fd, &fdnum))
+    ) {
+        return NULL;
+    }
+    if ((entry->io.events & (EV_READ | EV_WRITE)) != events) {
+        __IoMux_modify__(watcher->loop->loop, &entry->io, events);
+    }
+    if (data) {
+        _Py_SET_MEMBER(entry->data, data);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* IoMux.remove(fd) -> data */
+static PyObject *
+IoMux_remove(IoMux *self, PyObject *fd)
+{
+    Watcher *watcher = (Watcher *)self;
+    IoMuxEntry *entry = NULL;
+    PyObject *data = NULL;
+    int fdnum = -1;
+
+    if (!(entry = __IoMux_lookup__(self, fd, &fdnum))) {
+        return NULL;
+    }
+    if (watcher->loop) {
+        ev_io_stop(watcher->loop->loop, &entry->io);
+    }
+    __IoMux_discard__(self, entry);
+    ev_io_set(&entry->io, -1, 0);
+    data = entry->data;
+    entry->data = NULL;
+    self->count--;
+    return data;
+}
+
+
+/* IoMux.get(fd) -> data */
+static PyObject *
+IoMux_get(IoMux *self, PyObject *fd)
+{
+    IoMuxEntry *entry = NULL;
+    int fdnum = -1;
+
+    if (!(entry = __IoMux_lookup__(self, fd, &fdnum))) {
+        return NULL;
+    }
+    return Py_NewRef(entry->data);
+}
+
+
+/* IoMux_Type.tp_methods */
+static PyMethodDef IoMux_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)IoMux_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)IoMux_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {
+        "add",
+        (PyCFunction)IoMux_add,
+        METH_VARARGS,
+        "add(fd, events[, data=None])"
+    },
+    {
+        "modify",
+        (PyCFunction)IoMux_modify,
+        METH_VARARGS,
+        "modify(fd, events[, data])"
+    },
+    {
+        "remove",
+        (PyCFunction)IoMux_remove,
+        METH_O,
+        "remove(fd) -> data"
+    },
+    {
+        "get",
+        (PyCFunction)IoMux_get,
+        METH_O,
+        "get(fd) -> data"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* IoMux.batch */
+static PyObject *
+IoMux_batch_getter(IoMux *self, void *closure)
+{
+    return PyBool_FromLong(self->batch);
+}
+
+static int
+IoMux_batch_setter(IoMux *self, PyObject *value, void *closure)
+{
+    int batch = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if ((batch = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    self->batch = batch;
+    return 0;
+}
+
+
+/* IoMux_Type.tp_getsets */
+static PyGetSetDef IoMux_tp_getsets[] = {
+    {
+        "batch",
+        (getter)IoMux_batch_getter,
+        (setter)IoMux_batch_setter,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject IoMux_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.IoMux",
+    .tp_basicsize = sizeof(IoMux),
+    .tp_dealloc = (destructor)IoMux_tp_dealloc,
+    .tp_as_sequence = &IoMux_tp_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "IoMux(loop, callback[, data=None, priority=0, batch=False])",
+    .tp_traverse = (traverseproc)IoMux_tp_traverse,
+    .tp_clear = (inquiry)IoMux_tp_clear,
+    .tp_methods = IoMux_tp_methods,
+    .tp_getset = IoMux_tp_getsets,
+    .tp_init = (initproc)IoMux_tp_init,
+    .tp_new = (newfunc)IoMux_tp_new,
+    .tp_finalize = (destructor)IoMux_tp_finalize,
+};
+
+
+#endif // !EV_ASYNC_ENABLE
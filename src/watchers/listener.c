@@ -0,0 +1,542 @@
+#include "watcher.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/* helpers ------------------------------------------------------------------ */
+
+#define __LISTENER_BATCH__ 64
+#define __LISTENER_BACKOFF__ 0.1
+
+
+#define __Listener_member__(S, c) \
+    (*((int *)(((char *)(S)) + ((size_t)(c)))))
+
+
+// best effort, conn might not be a tcp socket
+static void
+__Listener_setup__(Listener *self, int conn)
+{
+    if (self->nodelay) {
+        setsockopt(
+            conn, IPPROTO_TCP, TCP_NODELAY,
+            &self->nodelay, sizeof(self->nodelay)
+        );
+    }
+    if (self->rcvbuf) {
+        setsockopt(
+            conn, SOL_SOCKET, SO_RCVBUF, &self->rcvbuf, sizeof(self->rcvbuf)
+        );
+    }
+    if (self->sndbuf) {
+        setsockopt(
+            conn, SOL_SOCKET, SO_SNDBUF, &self->sndbuf, sizeof(self->sndbuf)
+        );
+    }
+}
+
+
+static void
+__Listener_close__(PyObject *conns)
+{
+    Py_ssize_t i;
+
+    for (i = 0; i < PyList_GET_SIZE(conns); i++) {
+        close(PyLong_AsLong(PyTuple_GET_ITEM(PyList_GET_ITEM(conns, i), 0)));
+    }
+}
+
+
+static int
+__Listener_append__(
+    PyObject *conns, int conn, struct sockaddr *addr, size_t len
+)
+{
+    PyObject *item = NULL, *fd = NULL, *address = NULL;
+    int result = -1;
+
+    if (
+        (fd = PyLong_FromLong(conn)) &&
+        (address = __Io_address__(addr, len)) &&
+        (item = PyTuple_Pack(2, fd, address))
+    ) {
+        result = PyList_Append(conns, item);
+    }
+    Py_XDECREF(item);
+    Py_XDECREF(address);
+    Py_XDECREF(fd);
+    return result;
+}
+
+
+// accept4() errors that leave the listening socket usable, 1 if only the
+// pending connection failed, 2 if we are (temporarily) out of resources
+static int
+__Listener_transient__(int error)
+{
+    switch (error) {
+        case ECONNABORTED:
+        case EPROTO:
+        case EPERM:
+        case ENETDOWN:
+        case ENOPROTOOPT:
+        case EHOSTDOWN:
+        case ENONET:
+        case EHOSTUNREACH:
+        case EOPNOTSUPP:
+        case ENETUNREACH:
+            return 1;
+        case EMFILE:
+        case ENFILE:
+        case ENOBUFS:
+        case ENOMEM:
+            return 2;
+    }
+    return 0;
+}
+
+
+// *done is set to 1 if accept() failed, 2 if it must be retried later (see
+// self->error)
+static PyObject *
+__Listener_accept__(Listener *self, int *done)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd, conn = -1, i;
+    struct sockaddr_storage addr;
+    socklen_t len = 0;
+    PyObject *conns = NULL;
+
+    if (!(conns = PyList_New(0))) {
+        return NULL;
+    }
+    for (i = 0; i < self->batch; i++) {
+        len = sizeof(addr);
+        if (
+            (conn = accept4(
+                fd, (struct sockaddr *)&addr, &len,
+                SOCK_NONBLOCK | SOCK_CLOEXEC
+            )) < 0
+        ) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            self->error = errno;
+            if ((*done = __Listener_transient__(errno)) == 1) {
+                *done = 0;
+                continue;
+            }
+            *done = *done ? 2 : 1;
+            break;
+        }
+        __Listener_setup__(self, conn);
+        if (__Listener_append__(conns, conn, (struct sockaddr *)&addr, len)) {
+            close(conn);
+            __Listener_close__(conns);
+            Py_CLEAR(conns);
+            break;
+        }
+    }
+    return conns;
+}
+
+
+// out of resources, stop accepting for a while (fd would stay readable)
+static void
+__Listener_pause__(Listener *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_loop *loop = watcher->loop->loop;
+
+    if (self->backoff > 0.0) {
+        ev_io_stop(loop, ((ev_io *)watcher->watcher));
+        ev_timer_set(self->retry, self->backoff, 0.0);
+        ev_timer_start(loop, self->retry);
+    }
+}
+
+
+static void
+__ev_listener_retry__(ev_loop *loop, ev_timer *timer, int revents)
+{
+    Watcher *self = timer->data;
+
+    ev_io_start(loop, ((ev_io *)self->watcher));
+}
+
+
+static void
+__ev_listener_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    Watcher *self = io->data;
+    PyObject *conns = NULL;
+    int done = 0;
+
+    if ((revents & EV_ERROR) || self->loop->collecting) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)io, revents);
+        return;
+    }
+    if (
+        !__Watcher_invoke_verify__(self) &&
+        (conns = __Listener_accept__((Listener *)self, &done))
+    ) {
+        if (self->callback == Py_None) {
+            // nobody to hand them to
+            __Listener_close__(conns);
+        }
+        else if (PyList_GET_SIZE(conns)) {
+            __Watcher_invoke_callback__(self, conns);
+        }
+        Py_DECREF(conns);
+        if (done == 2) {
+            __Listener_pause__((Listener *)self);
+        }
+        else if (done) {
+            __ev_watcher_stop__(loop, self->watcher, self->ev_type);
+            if (!PyErr_Occurred() && (self->callback != Py_None)) {
+                __Watcher_invoke_callback__(self, Py_None);
+            }
+        }
+    }
+    if (
+        PyErr_Occurred() ||
+        (!self->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   Listener
+   -------------------------------------------------------------------------- */
+
+static Listener *
+__Listener_alloc__(PyTypeObject *type)
+{
+    Listener *self = NULL;
+
+    if ((self = (Listener *)__Watcher_alloc__(type))) {
+        self->retry = NULL;
+        self->backoff = __LISTENER_BACKOFF__;
+        self->batch = __LISTENER_BATCH__;
+        self->nodelay = 0;
+        self->rcvbuf = 0;
+        self->sndbuf = 0;
+        self->error = 0;
+    }
+    return self;
+}
+
+
+static int
+__Listener_post_alloc__(Listener *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    if (!(self->retry = PyMem_Malloc(sizeof(ev_timer)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    ev_timer_init(self->retry, __ev_listener_retry__, 0.0, 0.0);
+    self->retry->data = self;
+    ev_set_cb(((ev_io *)watcher->watcher), __ev_listener_invoke__);
+    return 0;
+}
+
+
+static void
+__Listener_finalize__(Listener *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (self->retry && watcher->loop && watcher->loop->loop) {
+        ev_timer_stop(watcher->loop->loop, self->retry);
+    }
+    __Watcher_finalize__(watcher);
+}
+
+
+static void
+__Listener_dealloc__(Listener *self)
+{
+    if (self->retry) {
+        PyMem_Free(self->retry);
+        self->retry = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Listener_Type.tp_dealloc */
+static void
+Listener_tp_dealloc(Listener *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __Watcher_clear__((Watcher *)self);
+    __Listener_dealloc__(self);
+}
+
+
+/* Listener_Type.tp_init */
+static int
+Listener_tp_init(Listener *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd",
+        "callback", "data", "priority", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *fd = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OO|Oi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd,
+            &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority)
+    ) {
+        return -1;
+    }
+    return __Io_set__((Watcher *)self, fd, EV_READ);
+}
+
+
+/* Listener_Type.tp_new */
+static PyObject *
+Listener_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    Listener *self = NULL;
+
+    if ((self = __Listener_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__Listener_post_alloc__(self, EV_IO, sizeof(ev_io))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Listener_Type.tp_finalize */
+static void
+Listener_tp_finalize(Listener *self)
+{
+    __Listener_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Listener.start() */
+static PyObject *
+Listener_start(Listener *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    // retry right away
+    ev_timer_stop(watcher->loop->loop, self->retry);
+    __ev_watcher_start__(
+        watcher->loop->loop, watcher->watcher, watcher->ev_type
+    );
+    Py_RETURN_NONE;
+}
+
+
+/* Listener.stop() */
+static PyObject *
+Listener_stop(Listener *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    ev_timer_stop(watcher->loop->loop, self->retry);
+    __ev_watcher_stop__(
+        watcher->loop->loop, watcher->watcher, watcher->ev_type
+    );
+    watcher->queued = 0;
+    Py_RETURN_NONE;
+}
+
+
+/* Listener_Type.tp_methods */
+static PyMethodDef Listener_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)Listener_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)Listener_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Listener.batch/Listener.rcvbuf/Listener.sndbuf */
+static PyObject *
+Listener_int_getter(Listener *self, void *closure)
+{
+    return PyLong_FromLong(__Listener_member__(self, closure));
+}
+
+static int
+Listener_int_setter(Listener *self, PyObject *value, void *closure)
+{
+    int size = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((size = _PyLong_AsInt(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (
+        (size < 0) ||
+        (!size && ((size_t)closure == offsetof(Listener, batch)))
+    ) {
+        PyErr_SetString(PyExc_ValueError, "invalid size");
+        return -1;
+    }
+    __Listener_member__(self, closure) = size;
+    return 0;
+}
+
+
+/* Listener.nodelay */
+static PyObject *
+Listener_nodelay_getter(Listener *self, void *closure)
+{
+    return PyBool_FromLong(self->nodelay);
+}
+
+static int
+Listener_nodelay_setter(Listener *self, PyObject *value, void *closure)
+{
+    int nodelay = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if ((nodelay = PyObject_IsTrue(value)) < 0) {
+        return -1;
+    }
+    self->nodelay = nodelay;
+    return 0;
+}
+
+
+/* Listener.backoff */
+static PyObject *
+Listener_backoff_getter(Listener *self, void *closure)
+{
+    return PyFloat_FromDouble(self->backoff);
+}
+
+static int
+Listener_backoff_setter(Listener *self, PyObject *value, void *closure)
+{
+    double backoff = -1.0;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((backoff = PyFloat_AsDouble(value)) == -1.0) && PyErr_Occurred()) {
+        return -1;
+    }
+    _Py_CHECK_POSITIVE_OR_ZERO_FLOAT(backoff, -1);
+    self->backoff = backoff;
+    return 0;
+}
+
+
+/* Listener.error */
+static PyObject *
+Listener_error_getter(Listener *self, void *closure)
+{
+    return PyLong_FromLong(self->error);
+}
+
+
+/* Listener_Type.tp_getsets */
+static PyGetSetDef Listener_tp_getsets[] = {
+    {
+        "batch",
+        (getter)Listener_int_getter,
+        (setter)Listener_int_setter,
+        NULL,
+        (void *)offsetof(Listener, batch)
+    },
+    {
+        "nodelay",
+        (getter)Listener_nodelay_getter,
+        (setter)Listener_nodelay_setter,
+        NULL,
+        NULL
+    },
+    {
+        "rcvbuf",
+        (getter)Listener_int_getter,
+        (setter)Listener_int_setter,
+        NULL,
+        (void *)offsetof(Listener, rcvbuf)
+    },
+    {
+        "sndbuf",
+        (getter)Listener_int_getter,
+        (setter)Listener_int_setter,
+        NULL,
+        (void *)offsetof(Listener, sndbuf)
+    },
+    {
+        "backoff",
+        (getter)Listener_backoff_getter,
+        (setter)Listener_backoff_setter,
+        NULL,
+        NULL
+    },
+    {
+        "error",
+        (getter)Listener_error_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Listener_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Listener",
+    .tp_basicsize = sizeof(Listener),
+    .tp_dealloc = (destructor)Listener_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "Listener(loop, fd, callback[, data=None, priority=0])",
+    .tp_methods = Listener_tp_methods,
+    .tp_getset = Listener_tp_getsets,
+    .tp_init = (initproc)Listener_tp_init,
+    .tp_new = (newfunc)Listener_tp_new,
+    .tp_finalize = (destructor)Listener_tp_finalize,
+};
@@ -0,0 +1,1130 @@
+#include "watcher.h"
+#include "capi.h"
+
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* handlers ----------------------------------------------------------------- */
+
+#define __NATIVE_BUFSIZE__ 65536
+#define __NATIVE_MAX_READS__ 16
+
+
+#define __native_again__(e) \
+    (((e) == EAGAIN) || ((e) == EWOULDBLOCK) || ((e) == EINTR))
+
+
+static int
+__native_read__(int fd, char *buf, ssize_t *size)
+{
+    if ((*size = read(fd, buf, __NATIVE_BUFSIZE__)) > 0) {
+        return 0;
+    }
+    if (!*size) { // eof
+        errno = 0;
+        return -1;
+    }
+    *size = 0;
+    return __native_again__(errno) ? 0 : -1;
+}
+
+
+// read and discard everything available on fd
+static int
+__native_drain__(int fd, int target, int revents, Py_ssize_t *bytes)
+{
+    char buf[__NATIVE_BUFSIZE__];
+    ssize_t size = 0;
+    int i;
+
+    for (i = 0; i < __NATIVE_MAX_READS__; i++) {
+        if (__native_read__(fd, buf, &size)) {
+            return -1;
+        }
+        if (!size) {
+            break;
+        }
+        *bytes += size;
+    }
+    return 0;
+}
+
+
+// only count events
+static int
+__native_count__(int fd, int target, int revents, Py_ssize_t *bytes)
+{
+    return 0;
+}
+
+
+static const struct {
+    const char *name;
+    NativeHandler func;
+} __native_handlers__[] = {
+    {"drain", __native_drain__},
+    {"count", __native_count__},
+    {NULL, NULL}
+};
+
+
+static NativeHandler
+__native_handler__(PyObject *handler)
+{
+    const char *name = NULL;
+    int i;
+
+    if (PyCapsule_CheckExact(handler)) {
+        return (NativeHandler)PyCapsule_GetPointer(
+            handler, MoodEvent_NativeHandler_NAME
+        );
+    }
+    if (!PyUnicode_Check(handler)) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "handler must be a str or a capsule, not %.200s",
+            Py_TYPE(handler)->tp_name
+        );
+        return NULL;
+    }
+    if (!(name = PyUnicode_AsUTF8(handler))) {
+        return NULL;
+    }
+    for (i = 0; __native_handlers__[i].name; i++) {
+        if (!strcmp(name, __native_handlers__[i].name)) {
+            return __native_handlers__[i].func;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "unknown handler: %R", handler);
+    return NULL;
+}
+
+
+/* helpers ------------------------------------------------------------------ */
+
+static void
+__NativeIo_stop__(NativeIo *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (ev_is_active(watcher->watcher)) {
+        ev_io_stop(watcher->loop->loop, ((ev_io *)watcher->watcher));
+        Loop_remove_native(watcher->loop, watcher->watcher);
+    }
+}
+
+
+// the handler stopped the watcher, report to the (optional) python callback
+static void
+__NativeIo_done__(NativeIo *self, int revents)
+{
+    Watcher *watcher = (Watcher *)self;
+    PyGILState_STATE gstate = PyGILState_Ensure();
+    PyObject *_revents_ = NULL;
+
+    if ((_revents_ = PyLong_FromLong(revents))) {
+        __Watcher_invoke_callback__(watcher, _revents_);
+        Py_DECREF(_revents_);
+    }
+    if (PyErr_Occurred() || PyErr_CheckSignals()) {
+        ev_loop_stop(watcher->loop->loop);
+    }
+    PyGILState_Release(gstate);
+}
+
+
+// may be called without the GIL
+static void
+__ev_native_io_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    NativeIo *self = io->data;
+    Py_ssize_t bytes = 0;
+    int result = -1;
+
+    self->count++;
+    if (revents & EV_ERROR) {
+        errno = errno ? errno : EIO;
+    }
+    else {
+        result = self->func(io->fd, self->target, revents, &bytes);
+        self->bytes += bytes;
+    }
+    if (result) {
+        self->error = errno;
+        __NativeIo_stop__(self);
+        if (((Watcher *)self)->callback != Py_None) {
+            __NativeIo_done__(self, revents);
+        }
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   NativeIo
+   -------------------------------------------------------------------------- */
+
+static NativeIo *
+__NativeIo_alloc__(PyTypeObject *type)
+{
+    NativeIo *self = NULL;
+
+    if ((self = (NativeIo *)__Watcher_alloc__(type))) {
+        self->handler = NULL;
+        self->func = NULL;
+        self->target = -1;
+        self->count = 0;
+        self->bytes = 0;
+        self->error = 0;
+    }
+    return self;
+}
+
+
+static int
+__NativeIo_post_alloc__(NativeIo *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    ev_set_cb(((ev_io *)watcher->watcher), __ev_native_io_invoke__);
+    return 0;
+}
+
+
+static void
+__NativeIo_finalize__(NativeIo *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (watcher->watcher && watcher->loop && watcher->loop->loop) {
+        __NativeIo_stop__(self);
+    }
+}
+
+
+static int
+__NativeIo_traverse__(NativeIo *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->handler);
+    return __Watcher_traverse__((Watcher *)self, visit, arg);
+}
+
+
+static int
+__NativeIo_clear__(NativeIo *self)
+{
+    Py_CLEAR(self->handler);
+    return __Watcher_clear__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static int
+__NativeIo_set__(NativeIo *self, PyObject *handler, PyObject *target)
+{
+    NativeHandler func = NULL;
+    int fdnum = -1;
+
+    if (
+        !(func = __native_handler__(handler)) ||
+        (
+            (target != Py_None) &&
+            ((fdnum = PyObject_AsFileDescriptor(target)) < 0)
+        )
+    ) {
+        return -1;
+    }
+    _Py_SET_MEMBER(self->handler, handler);
+    self->func = func;
+    self->target = fdnum;
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* NativeIo_Type.tp_dealloc */
+static void
+NativeIo_tp_dealloc(NativeIo *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __NativeIo_clear__(self);
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* NativeIo_Type.tp_traverse */
+static int
+NativeIo_tp_traverse(NativeIo *self, visitproc visit, void *arg)
+{
+    return __NativeIo_traverse__(self, visit, arg);
+}
+
+
+/* NativeIo_Type.tp_clear */
+static int
+NativeIo_tp_clear(NativeIo *self)
+{
+    return __NativeIo_clear__(self);
+}
+
+
+/* NativeIo_Type.tp_init */
+static int
+NativeIo_tp_init(NativeIo *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd", "events", "handler",
+        "target", "callback", "data", "priority", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *fd = NULL;
+    int events = 0;
+    PyObject *handler = NULL, *target = Py_None;
+    PyObject *callback = Py_None, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OiO|OOOi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd, &events, &handler,
+            &target, &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, events)
+    ) {
+        return -1;
+    }
+    return __NativeIo_set__(self, handler, target);
+}
+
+
+/* NativeIo_Type.tp_new */
+static PyObject *
+NativeIo_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    NativeIo *self = NULL;
+
+    if ((self = __NativeIo_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__NativeIo_post_alloc__(self, EV_IO, sizeof(ev_io))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* NativeIo_Type.tp_finalize */
+static void
+NativeIo_tp_finalize(NativeIo *self)
+{
+    __NativeIo_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* NativeIo.start() */
+static PyObject *
+NativeIo_start(NativeIo *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (!ev_is_active(watcher->watcher)) {
+        if (Loop_add_native(watcher->loop, watcher->watcher)) {
+            return NULL;
+        }
+        self->error = 0;
+        ev_io_start(watcher->loop->loop, ((ev_io *)watcher->watcher));
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* NativeIo.stop() */
+static PyObject *
+NativeIo_stop(NativeIo *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    __NativeIo_stop__(self);
+    ev_clear_pending(watcher->loop->loop, watcher->watcher);
+    Py_RETURN_NONE;
+}
+
+
+/* NativeIo_Type.tp_methods */
+static PyMethodDef NativeIo_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)NativeIo_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)NativeIo_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* NativeIo.handler */
+static PyObject *
+NativeIo_handler_getter(NativeIo *self, void *closure)
+{
+    return Py_NewRef(self->handler);
+}
+
+
+/* NativeIo.target */
+static PyObject *
+NativeIo_target_getter(NativeIo *self, void *closure)
+{
+    if (self->target < 0) {
+        Py_RETURN_NONE;
+    }
+    return PyLong_FromLong(self->target);
+}
+
+
+/* NativeIo.count/NativeIo.bytes */
+static PyObject *
+NativeIo_counter_getter(NativeIo *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(closure ? self->bytes : self->count);
+}
+
+
+/* NativeIo.error */
+static PyObject *
+NativeIo_error_getter(NativeIo *self, void *closure)
+{
+    return PyLong_FromLong(self->error);
+}
+
+
+/* NativeIo_Type.tp_getsets */
+static PyGetSetDef NativeIo_tp_getsets[] = {
+    {
+        "handler",
+        (getter)NativeIo_handler_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "target",
+        (getter)NativeIo_target_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "count",
+        (getter)NativeIo_counter_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "bytes",
+        (getter)NativeIo_counter_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        Py_True
+    },
+    {
+        "error",
+        (getter)NativeIo_error_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject NativeIo_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.NativeIo",
+    .tp_basicsize = sizeof(NativeIo),
+    .tp_dealloc = (destructor)NativeIo_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "NativeIo(loop, fd, events, handler[, target=None, callback=None, data=None, priority=0])",
+    .tp_traverse = (traverseproc)NativeIo_tp_traverse,
+    .tp_clear = (inquiry)NativeIo_tp_clear,
+    .tp_methods = NativeIo_tp_methods,
+    .tp_getset = NativeIo_tp_getsets,
+    .tp_init = (initproc)NativeIo_tp_init,
+    .tp_new = (newfunc)NativeIo_tp_new,
+    .tp_finalize = (destructor)NativeIo_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   FileSender
+   -------------------------------------------------------------------------- */
+
+// sends until fd is full, returns 1 when done (see error)
+static int
+__FileSender_send__(FileSender *self, int fd)
+{
+    NativeIo *native = (NativeIo *)self;
+    ssize_t n = 0;
+
+    while (self->remaining) {
+        n = sendfile(fd, native->target, &self->offset, self->remaining);
+        if (n > 0) {
+            self->remaining -= n;
+            native->bytes += n;
+        }
+        else if (!n) { // file is shorter than expected
+            native->error = ENODATA;
+            return 1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return 0;
+        }
+        else {
+            native->error = errno;
+            return 1;
+        }
+    }
+    return 1;
+}
+
+
+// may be called without the GIL
+static void
+__ev_file_sender_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    NativeIo *self = io->data;
+    int done = 1;
+
+    self->count++;
+    if (revents & EV_ERROR) {
+        self->error = errno ? errno : EIO;
+    }
+    else {
+        done = __FileSender_send__((FileSender *)self, io->fd);
+    }
+    if (done) {
+        __NativeIo_stop__(self);
+        if (((Watcher *)self)->callback != Py_None) {
+            __NativeIo_done__(self, revents);
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static int
+__FileSender_set__(
+    FileSender *self, PyObject *file, Py_ssize_t offset, PyObject *count
+)
+{
+    NativeIo *native = (NativeIo *)self;
+    Py_ssize_t remaining = -1;
+    struct stat st;
+    int fdnum = -1;
+
+    if ((fdnum = PyObject_AsFileDescriptor(file)) < 0) {
+        return -1;
+    }
+    if (offset < 0) {
+        PyErr_SetString(PyExc_ValueError, "offset must be positive");
+        return -1;
+    }
+    if (count == Py_None) { // up to the end of file
+        if (fstat(fdnum, &st)) {
+            _PyErr_SetFromErrno();
+            return -1;
+        }
+        remaining = Py_MAX(0, st.st_size - offset);
+    }
+    else if (
+        ((remaining = PyLong_AsSsize_t(count)) == -1) && PyErr_Occurred()
+    ) {
+        return -1;
+    }
+    else if (remaining < 0) {
+        PyErr_SetString(PyExc_ValueError, "count must be positive");
+        return -1;
+    }
+    native->target = fdnum;
+    self->offset = offset;
+    self->remaining = remaining;
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* FileSender_Type.tp_init */
+static int
+FileSender_tp_init(FileSender *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd", "file", "offset", "count",
+        "callback", "data", "priority", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *fd = NULL, *file = NULL, *count = NULL;
+    Py_ssize_t offset = 0;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OOnOO|Oi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd, &file, &offset, &count,
+            &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, EV_WRITE)
+    ) {
+        return -1;
+    }
+    return __FileSender_set__(self, file, offset, count);
+}
+
+
+/* FileSender_Type.tp_new */
+static PyObject *
+FileSender_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    NativeIo *self = NULL;
+
+    if ((self = __NativeIo_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (
+            __NativeIo_post_alloc__(self, EV_IO, sizeof(ev_io)) ||
+            !(self->handler = PyUnicode_InternFromString("sendfile"))
+        ) {
+            Py_CLEAR(self);
+        }
+        else {
+            ev_set_cb(
+                ((ev_io *)((Watcher *)self)->watcher), __ev_file_sender_invoke__
+            );
+            ((FileSender *)self)->offset = 0;
+            ((FileSender *)self)->remaining = 0;
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* FileSender.offset */
+static PyObject *
+FileSender_offset_getter(FileSender *self, void *closure)
+{
+    return PyLong_FromLongLong(self->offset);
+}
+
+
+/* FileSender.remaining */
+static PyObject *
+FileSender_remaining_getter(FileSender *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->remaining);
+}
+
+
+/* FileSender_Type.tp_getsets */
+static PyGetSetDef FileSender_tp_getsets[] = {
+    {
+        "offset",
+        (getter)FileSender_offset_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "remaining",
+        (getter)FileSender_remaining_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject FileSender_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.FileSender",
+    .tp_basicsize = sizeof(FileSender),
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "FileSender(loop, fd, file, offset, count, callback[, data=None, priority=0])",
+    .tp_getset = FileSender_tp_getsets,
+    .tp_init = (initproc)FileSender_tp_init,
+    .tp_new = (newfunc)FileSender_tp_new,
+};
+
+
+/* --------------------------------------------------------------------------
+   Splice
+   -------------------------------------------------------------------------- */
+
+#define __SPLICE_CHUNK__ (256 * 1024)
+
+#define __SPLICE_FLAGS__ (SPLICE_F_MOVE | SPLICE_F_NONBLOCK)
+
+
+// src -> pipe, returns -1 on error
+static int
+__SpliceFlow_pull__(SpliceFlow *flow)
+{
+    ssize_t n = 0;
+
+    while (!flow->eof) {
+        n = splice(
+            flow->src, NULL, flow->pipe[1], NULL,
+            __SPLICE_CHUNK__, __SPLICE_FLAGS__
+        );
+        if (n > 0) {
+            flow->pending += n;
+        }
+        else if (!n) {
+            flow->eof = 1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            break; // src is empty or the pipe is full
+        }
+        else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+// pipe -> dst, returns -1 on error
+static int
+__SpliceFlow_push__(SpliceFlow *flow)
+{
+    ssize_t n = 0;
+
+    while (flow->pending) {
+        n = splice(
+            flow->pipe[0], NULL, flow->dst, NULL,
+            flow->pending, __SPLICE_FLAGS__
+        );
+        if (n > 0) {
+            flow->pending -= n;
+            flow->bytes += n;
+        }
+        else if ((n < 0) && (errno == EINTR)) {
+            continue;
+        }
+        else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+            return 0;
+        }
+        else {
+            return -1;
+        }
+    }
+    if (flow->eof) {
+        // propagate the half close, best effort (dst might not be a socket)
+        shutdown(flow->dst, SHUT_WR);
+    }
+    return 0;
+}
+
+
+#define __SpliceFlow_done__(f) ((f)->eof && !(f)->pending)
+
+
+// only read when the pipe is empty, write while it is not
+#define __Splice_events__(in, out) \
+    ( \
+        ((!(in)->eof && !(in)->pending) ? EV_READ : 0) | \
+        ((out)->pending ? EV_WRITE : 0) \
+    )
+
+
+static void
+__Splice_modify__(ev_loop *loop, ev_io *io, int events)
+{
+    if ((io->events & (EV_READ | EV_WRITE)) != events) {
+        ev_io_stop(loop, io);
+        ev_io_modify(io, events);
+        ev_io_start(loop, io);
+    }
+}
+
+
+static void
+__Splice_stop__(Splice *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (ev_is_active(self->peer)) {
+        ev_io_stop(watcher->loop->loop, self->peer);
+        Loop_remove_native(watcher->loop, (ev_watcher *)self->peer);
+    }
+    __NativeIo_stop__((NativeIo *)self);
+}
+
+
+// may be called without the GIL
+static void
+__ev_splice_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    Splice *self = io->data;
+    NativeIo *native = (NativeIo *)self;
+    SpliceFlow *in = &self->flows[(io == self->peer)];
+    SpliceFlow *out = &self->flows[(io != self->peer)];
+    int result = 0;
+
+    native->count++;
+    if (revents & EV_ERROR) {
+        errno = errno ? errno : EIO;
+        result = -1;
+    }
+    else {
+        if (revents & EV_READ) {
+            // push right away, dst is most likely writable
+            result = __SpliceFlow_pull__(in) || __SpliceFlow_push__(in);
+        }
+        if (!result && (revents & EV_WRITE)) {
+            result = __SpliceFlow_push__(out);
+        }
+    }
+    native->bytes = self->flows[0].bytes + self->flows[1].bytes;
+    if (
+        result ||
+        (__SpliceFlow_done__(&self->flows[0]) &&
+         __SpliceFlow_done__(&self->flows[1]))
+    ) {
+        native->error = result ? errno : 0;
+        __Splice_stop__(self);
+        if (((Watcher *)self)->callback != Py_None) {
+            __NativeIo_done__(native, revents);
+        }
+        return;
+    }
+    __Splice_modify__(
+        loop,
+        ((ev_io *)((Watcher *)self)->watcher),
+        __Splice_events__(&self->flows[0], &self->flows[1])
+    );
+    __Splice_modify__(
+        loop,
+        self->peer,
+        __Splice_events__(&self->flows[1], &self->flows[0])
+    );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static void
+__SpliceFlow_init__(SpliceFlow *flow, int src, int dst)
+{
+    flow->src = src;
+    flow->dst = dst;
+    flow->pending = 0;
+    flow->eof = 0;
+    flow->bytes = 0;
+}
+
+
+static int
+__SpliceFlow_open__(SpliceFlow *flow)
+{
+    if (pipe2(flow->pipe, O_NONBLOCK | O_CLOEXEC)) {
+        _PyErr_SetFromErrno();
+        return -1;
+    }
+    // best effort
+    fcntl(flow->pipe[1], F_SETPIPE_SZ, __SPLICE_CHUNK__);
+    return 0;
+}
+
+
+static void
+__SpliceFlow_close__(SpliceFlow *flow)
+{
+    if (flow->pipe[0] >= 0) {
+        close(flow->pipe[0]);
+        close(flow->pipe[1]);
+        flow->pipe[0] = flow->pipe[1] = -1;
+    }
+}
+
+
+static void
+__Splice_finalize__(Splice *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (
+        watcher->watcher && self->peer && watcher->loop && watcher->loop->loop
+    ) {
+        __Splice_stop__(self);
+    }
+}
+
+
+static void
+__Splice_dealloc__(Splice *self)
+{
+    __SpliceFlow_close__(&self->flows[0]);
+    __SpliceFlow_close__(&self->flows[1]);
+    if (self->peer) {
+        PyMem_Free(self->peer);
+        self->peer = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Splice_Type.tp_dealloc */
+static void
+Splice_tp_dealloc(Splice *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __NativeIo_clear__((NativeIo *)self);
+    __Splice_dealloc__(self);
+}
+
+
+/* Splice_Type.tp_init */
+static int
+Splice_tp_init(Splice *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd", "target",
+        "callback", "data", "priority", NULL
+    };
+
+    NativeIo *native = (NativeIo *)self;
+    Loop *loop = NULL;
+    PyObject *fd = NULL, *target = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0, fdnum = -1;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OOO|Oi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd, &target,
+            &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, EV_READ) ||
+        ((native->target = PyObject_AsFileDescriptor(target)) < 0)
+    ) {
+        return -1;
+    }
+    fdnum = ((ev_io *)((Watcher *)self)->watcher)->fd;
+    ev_io_set(self->peer, native->target, EV_READ);
+    ev_set_priority(self->peer, priority);
+    __SpliceFlow_close__(&self->flows[0]);
+    __SpliceFlow_close__(&self->flows[1]);
+    __SpliceFlow_init__(&self->flows[0], fdnum, native->target);
+    __SpliceFlow_init__(&self->flows[1], native->target, fdnum);
+    if (
+        __SpliceFlow_open__(&self->flows[0]) ||
+        __SpliceFlow_open__(&self->flows[1])
+    ) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Splice_Type.tp_new */
+static PyObject *
+Splice_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    NativeIo *self = NULL;
+    Splice *splice = NULL;
+
+    if ((self = __NativeIo_alloc__(type))) {
+        splice = (Splice *)self;
+        splice->peer = NULL;
+        splice->flows[0].pipe[0] = splice->flows[0].pipe[1] = -1;
+        splice->flows[1].pipe[0] = splice->flows[1].pipe[1] = -1;
+        PyObject_GC_Track(self);
+        if (
+            __NativeIo_post_alloc__(self, EV_IO, sizeof(ev_io)) ||
+            !(self->handler = PyUnicode_InternFromString("splice"))
+        ) {
+            Py_CLEAR(self);
+        }
+        else if (!(splice->peer = PyMem_Malloc(sizeof(ev_io)))) {
+            PyErr_NoMemory();
+            Py_CLEAR(self);
+        }
+        else {
+            ev_set_cb(
+                ((ev_io *)((Watcher *)self)->watcher), __ev_splice_invoke__
+            );
+            ev_init(splice->peer, __ev_splice_invoke__);
+            splice->peer->data = self;
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Splice_Type.tp_finalize */
+static void
+Splice_tp_finalize(Splice *self)
+{
+    __Splice_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Splice.start() */
+static PyObject *
+Splice_start(Splice *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_io *io = (ev_io *)watcher->watcher;
+
+    if (!ev_is_active(io)) {
+        if (
+            __SpliceFlow_done__(&self->flows[0]) &&
+            __SpliceFlow_done__(&self->flows[1])
+        ) {
+            // nothing left to watch, it would stay active forever
+            PyErr_SetString(EventError, "cannot restart a finished Splice");
+            return NULL;
+        }
+        if (Loop_add_native(watcher->loop, watcher->watcher)) {
+            return NULL;
+        }
+        if (Loop_add_native(watcher->loop, (ev_watcher *)self->peer)) {
+            Loop_remove_native(watcher->loop, watcher->watcher);
+            return NULL;
+        }
+        ((NativeIo *)self)->error = 0;
+        ev_io_modify(io, __Splice_events__(&self->flows[0], &self->flows[1]));
+        ev_io_modify(
+            self->peer, __Splice_events__(&self->flows[1], &self->flows[0])
+        );
+        ev_io_start(watcher->loop->loop, io);
+        ev_io_start(watcher->loop->loop, self->peer);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Splice.stop() */
+static PyObject *
+Splice_stop(Splice *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    __Splice_stop__(self);
+    ev_clear_pending(watcher->loop->loop, (ev_watcher *)self->peer);
+    ev_clear_pending(watcher->loop->loop, watcher->watcher);
+    Py_RETURN_NONE;
+}
+
+
+/* Splice_Type.tp_methods */
+static PyMethodDef Splice_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)Splice_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)Splice_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Splice.transferred */
+static PyObject *
+Splice_transferred_getter(Splice *self, void *closure)
+{
+    return Py_BuildValue(
+        "(KK)", self->flows[0].bytes, self->flows[1].bytes
+    );
+}
+
+
+/* Splice_Type.tp_getsets */
+static PyGetSetDef Splice_tp_getsets[] = {
+    {
+        "transferred",
+        (getter)Splice_transferred_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Splice_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Splice",
+    .tp_basicsize = sizeof(Splice),
+    .tp_dealloc = (destructor)Splice_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "Splice(loop, fd, target, callback[, data=None, priority=0])",
+    .tp_methods = Splice_tp_methods,
+    .tp_getset = Splice_tp_getsets,
+    .tp_init = (initproc)Splice_tp_init,
+    .tp_new = (newfunc)Splice_tp_new,
+    .tp_finalize = (destructor)Splice_tp_finalize,
+};
@@ -0,0 +1,1857 @@
+#include "watcher.h"
+
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+
+/* helpers ------------------------------------------------------------------ */
+
+#define __STREAM_BUFSIZE__ 65536
+#define __STREAM_BUDGET__ (4 * __STREAM_BUFSIZE__)
+#define __STREAM_MAX_SIZE__ (16 * 1024 * 1024)
+#define __STREAM_HIGH__ 65536
+#define __STREAM_LOW__ 16384
+#define __STREAM_IOV_MAX__ 64
+#define __STREAM_ZEROCOPY__ 16384
+
+
+#define __Stream_len__(S) ((S)->end - (S)->start)
+
+
+static unsigned long long
+__Stream_decode__(const unsigned char *p, int size, int little)
+{
+    unsigned long long n = 0;
+    int i;
+
+    if (little) {
+        for (i = size; i--;) {
+            n = (n << 8) | p[i];
+        }
+    }
+    else {
+        for (i = 0; i < size; i++) {
+            n = (n << 8) | p[i];
+        }
+    }
+    return n;
+}
+
+
+// struct-like length prefix: [<|>|!]H|I|Q (default: big-endian)
+static int
+__Stream_parse_prefix__(Stream *self, PyObject *framer)
+{
+    const char *format = NULL;
+    int little = 0;
+
+    if (!(format = PyUnicode_AsUTF8(framer))) {
+        return -1;
+    }
+    switch (*format) {
+        case '<':
+            little = 1;
+            /* fallthrough */
+        case '>':
+        case '!':
+            format++;
+            break;
+        default:
+            break;
+    }
+    if (format[0] && !format[1]) {
+        switch (format[0]) {
+            case 'H':
+                self->prefix = 2;
+                break;
+            case 'I':
+                self->prefix = 4;
+                break;
+            case 'Q':
+                self->prefix = 8;
+                break;
+            default:
+                self->prefix = 0;
+                break;
+        }
+        if (self->prefix) {
+            self->little = little;
+            return 0;
+        }
+    }
+    PyErr_Format(PyExc_ValueError, "invalid length prefix: %R", framer);
+    return -1;
+}
+
+
+int
+__Stream_set_framer__(Stream *self, PyObject *framer)
+{
+    if (PyBytes_Check(framer)) {
+        if (!PyBytes_GET_SIZE(framer)) {
+            PyErr_SetString(PyExc_ValueError, "empty delimiter");
+            return -1;
+        }
+        self->kind = STREAM_DELIMITER;
+    }
+    else if (PyLong_Check(framer)) {
+        if (
+            ((self->fixed = PyLong_AsSsize_t(framer)) == -1) &&
+            PyErr_Occurred()
+        ) {
+            return -1;
+        }
+        if (self->fixed <= 0) {
+            PyErr_SetString(PyExc_ValueError, "size must be greater than 0");
+            return -1;
+        }
+        self->kind = STREAM_FIXED;
+    }
+    else if (PyUnicode_Check(framer)) {
+        if (__Stream_parse_prefix__(self, framer)) {
+            return -1;
+        }
+        self->kind = STREAM_PREFIX;
+    }
+    else {
+        PyErr_Format(
+            PyExc_TypeError,
+            "framer must be bytes, int or str, not %.200s",
+            Py_TYPE(framer)->tp_name
+        );
+        return -1;
+    }
+    _Py_SET_MEMBER(self->framer, framer);
+    self->scanned = 0;
+    return 0;
+}
+
+
+/* buffer ------------------------------------------------------------------- */
+
+// frames still exported, keep their storage until they are released
+static int
+__Stream_retire__(Stream *self)
+{
+    StreamChunk *chunk = NULL;
+
+    if (!(chunk = PyMem_Malloc(sizeof(StreamChunk)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    chunk->data = self->data;
+    chunk->next = self->retired;
+    self->retired = chunk;
+    return 0;
+}
+
+
+static void
+__Stream_free_retired__(Stream *self)
+{
+    StreamChunk *chunk = NULL;
+
+    while ((chunk = self->retired)) {
+        self->retired = chunk->next;
+        PyMem_Free(chunk->data);
+        PyMem_Free(chunk);
+    }
+}
+
+
+// make room for at least size bytes at the end of the buffer
+static int
+__Stream_reserve__(Stream *self, Py_ssize_t size)
+{
+    Py_ssize_t len = __Stream_len__(self), newsize = 0;
+    char *data = NULL;
+
+    if ((self->size - self->end) >= size) {
+        return 0;
+    }
+    if (!self->exports && ((self->size - len) >= size)) {
+        memmove(self->data, self->data + self->start, len);
+        self->start = 0;
+        self->end = len;
+        return 0;
+    }
+    for (
+        newsize = Py_MAX(self->size, __STREAM_BUFSIZE__);
+        (newsize - len) < size;
+        newsize *= 2
+    );
+    if (!(data = PyMem_Malloc(newsize))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    if (self->exports && __Stream_retire__(self)) {
+        PyMem_Free(data);
+        return -1;
+    }
+    if (len) {
+        memcpy(data, self->data + self->start, len);
+    }
+    if (!self->exports) {
+        PyMem_Free(self->data);
+    }
+    self->data = data;
+    self->start = 0;
+    self->end = len;
+    self->size = newsize;
+    return 0;
+}
+
+
+static ssize_t
+__Stream_recv__(Stream *self, char *buf, size_t size)
+{
+    return read(((ev_io *)((Watcher *)self)->watcher)->fd, buf, size);
+}
+
+
+// returns 1 on eof or error (see self->error), -1 with an exception set
+static int
+__Stream_read__(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    Py_ssize_t total = 0, size = 0;
+    ssize_t n = 0;
+
+    while (total < self->budget) {
+        size = Py_MIN(self->budget - total, __STREAM_BUFSIZE__);
+        if (__Stream_reserve__(self, size)) {
+            return -1;
+        }
+        if ((n = self->ops->recv(self, self->data + self->end, size)) > 0) {
+            self->end += n;
+            total += n;
+            if (n < size) {
+                break; // drained
+            }
+        }
+        else if (!n) {
+            self->error = 0;
+            return 1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            break;
+        }
+        else {
+            self->error = errno;
+            return 1;
+        }
+    }
+    if (self->ops->buffered && self->ops->buffered(self)) {
+        // already pulled from fd, which might not be readable again
+        ev_feed_event(watcher->loop->loop, watcher->watcher, EV_READ);
+    }
+    return 0;
+}
+
+
+/* frames ------------------------------------------------------------------- */
+
+// returns 1 if a frame was found, 0 if incomplete, -1 if too large
+static int
+__Stream_next__(Stream *self)
+{
+    char *start = self->data + self->start, *found = NULL;
+    Py_ssize_t len = __Stream_len__(self), dlen = 0;
+    unsigned long long size = 0;
+
+    switch (self->kind) {
+        case STREAM_DELIMITER:
+            dlen = PyBytes_GET_SIZE(self->framer);
+            if (
+                (found = memmem(
+                    start + self->scanned, len - self->scanned,
+                    PyBytes_AS_STRING(self->framer), dlen
+                ))
+            ) {
+                self->frame = start;
+                self->frame_len = found - start;
+                self->start += self->frame_len + dlen;
+                self->scanned = 0;
+                return 1;
+            }
+            if (len > self->max_size) {
+                return -1;
+            }
+            // do not search the same bytes again
+            self->scanned = Py_MAX(0, len - dlen + 1);
+            return 0;
+        case STREAM_PREFIX:
+            if (len < self->prefix) {
+                return 0;
+            }
+            size = __Stream_decode__(
+                (const unsigned char *)start, self->prefix, self->little
+            );
+            if (size > (unsigned long long)self->max_size) {
+                return -1;
+            }
+            if ((unsigned long long)(len - self->prefix) < size) {
+                return 0;
+            }
+            self->frame = start + self->prefix;
+            self->frame_len = (Py_ssize_t)size;
+            self->start += self->prefix + self->frame_len;
+            return 1;
+        case STREAM_FIXED:
+            if (len < self->fixed) {
+                return 0;
+            }
+            self->frame = start;
+            self->frame_len = self->fixed;
+            self->start += self->fixed;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+
+// *done is set to 1 if a frame is too large
+static PyObject *
+__Stream_frames__(Stream *self, int *done)
+{
+    PyObject *frames = NULL, *frame = NULL;
+    int found = 0;
+
+    if (!(frames = PyList_New(0))) {
+        return NULL;
+    }
+    while ((found = __Stream_next__(self)) > 0) {
+        // exported through Stream_bf_getbuffer
+        frame = PyMemoryView_FromObject((PyObject *)self);
+        self->frame = NULL;
+        if (!frame || PyList_Append(frames, frame)) {
+            Py_XDECREF(frame);
+            Py_CLEAR(frames);
+            return NULL;
+        }
+        Py_DECREF(frame);
+    }
+    if (found < 0) {
+        self->error = EMSGSIZE;
+        *done = 1;
+    }
+    if (!__Stream_len__(self) && !self->exports) {
+        self->start = self->end = 0;
+    }
+    return frames;
+}
+
+
+/* write queue -------------------------------------------------------------- */
+
+static void
+__Stream_set_writing__(Stream *self, int writing)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_io *io = (ev_io *)watcher->watcher;
+    int events = io->events & (EV_READ | EV_WRITE);
+    int wanted = writing ? (events | EV_WRITE) : (events & ~EV_WRITE);
+    int active = ev_is_active(io);
+
+    if (wanted != events) {
+        if (active) {
+            ev_io_stop(watcher->loop->loop, io);
+        }
+        ev_io_modify(io, wanted);
+        if (active) {
+            ev_io_start(watcher->loop->loop, io);
+        }
+    }
+}
+
+
+// steals the reference to view
+static int
+__Stream_push__(Stream *self, Py_buffer *view)
+{
+    Py_buffer *writes = self->writes;
+    Py_ssize_t size = self->writes_size;
+
+    if (self->writes_len == size) {
+        if (self->writes_sent) {
+            self->writes_len -= self->writes_sent;
+            self->writes_head -= self->writes_sent;
+            memmove(
+                writes,
+                writes + self->writes_sent,
+                self->writes_len * sizeof(Py_buffer)
+            );
+            self->writes_sent = 0;
+        }
+        else {
+            size = size ? (size * 2) : 16;
+            if (!PyMem_Resize(writes, Py_buffer, size)) {
+                PyErr_NoMemory();
+                return -1;
+            }
+            self->writes = writes;
+            self->writes_size = size;
+        }
+    }
+    self->writes[self->writes_len++] = *view;
+    self->buffered += view->len;
+    return 0;
+}
+
+
+// returns the number of views completely written
+static Py_ssize_t
+__Stream_consume__(Stream *self, Py_ssize_t size)
+{
+    Py_buffer *view = NULL;
+    Py_ssize_t left = 0, count = 0;
+
+    self->buffered -= size;
+    while (size) {
+        view = &self->writes[self->writes_head];
+        if (size < (left = view->len - self->offset)) {
+            self->offset += size;
+            break;
+        }
+        size -= left;
+        self->offset = 0;
+        self->writes_head++;
+        count++;
+    }
+    return count;
+}
+
+
+// release the count oldest written views
+static void
+__Stream_release__(Stream *self, Py_ssize_t count)
+{
+    while (count--) {
+        PyBuffer_Release(&self->writes[self->writes_sent++]);
+    }
+    if (self->writes_sent == self->writes_len) {
+        self->writes_sent = self->writes_head = self->writes_len = 0;
+    }
+}
+
+
+static void
+__Stream_clear_writes__(Stream *self)
+{
+    // pending completions are lost, keep zckey in sync with the kernel
+    self->zckey += (uint32_t)(self->completions_len - self->completions_head);
+    self->completions_head = self->completions_len = 0;
+    __Stream_release__(self, self->writes_len - self->writes_sent);
+    self->offset = 0;
+    self->buffered = 0;
+}
+
+
+// drop what was not written, keep what the kernel might still be reading
+// (zero copy sends not acknowledged yet) until it is acknowledged
+static void
+__Stream_drop_writes__(Stream *self)
+{
+    Py_ssize_t head = self->writes_head;
+
+    if (self->completions_head == self->completions_len) {
+        __Stream_clear_writes__(self);
+        return;
+    }
+    if (self->offset) {
+        // partially written, possibly with zero copy
+        self->completions[self->completions_len - 1].views++;
+        head++;
+    }
+    while (self->writes_len > head) {
+        PyBuffer_Release(&self->writes[--self->writes_len]);
+    }
+    self->writes_head = self->writes_len;
+    self->offset = 0;
+    self->buffered = 0;
+}
+
+
+/* zero copy ---------------------------------------------------------------- */
+
+static int
+__Stream_reserve_completion__(Stream *self)
+{
+    StreamCompletion *completions = self->completions;
+    Py_ssize_t size = self->completions_size;
+
+    if (self->completions_len == size) {
+        if (self->completions_head) {
+            self->completions_len -= self->completions_head;
+            memmove(
+                completions,
+                completions + self->completions_head,
+                self->completions_len * sizeof(StreamCompletion)
+            );
+            self->completions_head = 0;
+        }
+        else {
+            size = size ? (size * 2) : 16;
+            if (!PyMem_Resize(completions, StreamCompletion, size)) {
+                return -1;
+            }
+            self->completions = completions;
+            self->completions_size = size;
+        }
+    }
+    return 0;
+}
+
+
+// written views are kept until the kernel is done with them
+static void
+__Stream_written__(Stream *self, Py_ssize_t count, int zerocopy)
+{
+    StreamCompletion *completion = NULL;
+
+    if (zerocopy) {
+        completion = &self->completions[self->completions_len++];
+        completion->views = count;
+        completion->done = 0;
+    }
+    else if (self->completions_len) {
+        // released with the last zero copy send (views are released in order)
+        self->completions[self->completions_len - 1].views += count;
+    }
+    else {
+        __Stream_release__(self, count);
+    }
+}
+
+
+static void
+__Stream_acknowledge__(Stream *self, uint32_t lo, uint32_t hi)
+{
+    Py_ssize_t pending = self->completions_len - self->completions_head;
+    uint32_t key, index;
+
+    for (key = lo; key != (hi + 1); key++) {
+        if ((index = key - self->zckey) < (uint32_t)pending) {
+            self->completions[self->completions_head + index].done = 1;
+        }
+    }
+    while (
+        (self->completions_head < self->completions_len) &&
+        self->completions[self->completions_head].done
+    ) {
+        __Stream_release__(
+            self, self->completions[self->completions_head++].views
+        );
+        self->zckey++;
+    }
+    if (self->completions_head == self->completions_len) {
+        self->completions_head = self->completions_len = 0;
+    }
+}
+
+
+// read zero copy completions from the error queue
+static void
+__Stream_complete__(Stream *self)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd;
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+    struct msghdr msg;
+    struct cmsghdr *cmsg = NULL;
+    struct sock_extended_err *serr = NULL;
+
+    for (;;) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; // empty (or not a socket)
+        }
+        for (
+            cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)
+        ) {
+            if (
+                ((cmsg->cmsg_level == SOL_IP) &&
+                 (cmsg->cmsg_type == IP_RECVERR)) ||
+                ((cmsg->cmsg_level == SOL_IPV6) &&
+                 (cmsg->cmsg_type == IPV6_RECVERR))
+            ) {
+                serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+                if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY) {
+                    __Stream_acknowledge__(self, serr->ee_info, serr->ee_data);
+                }
+            }
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static ssize_t
+__Stream_send__(Stream *self, struct iovec *iov, int count, int *zerocopy)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd;
+    struct msghdr msg;
+    ssize_t n = -1;
+
+    if (*zerocopy) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        if (
+            ((n = sendmsg(fd, &msg, MSG_ZEROCOPY)) >= 0) ||
+            (errno != ENOBUFS)
+        ) {
+            return n;
+        }
+        *zerocopy = 0; // out of optmem, fall back to copying
+    }
+    return writev(fd, iov, count);
+}
+
+
+static const StreamOps __Stream_ops__ = {
+    .recv = __Stream_recv__,
+    .send = __Stream_send__,
+};
+
+
+// one writev per round, returns 1 on error (see self->error)
+static int
+__Stream_flush__(Stream *self, Py_ssize_t threshold)
+{
+    struct iovec iov[__STREAM_IOV_MAX__];
+    Py_ssize_t i, count, size;
+    Py_buffer *view = NULL;
+    ssize_t n = 0;
+    int zerocopy = 0, writing = 0;
+
+    while (self->writes_head < self->writes_len) {
+        for (
+            i = self->writes_head, count = 0, size = 0;
+            (i < self->writes_len) && (count < __STREAM_IOV_MAX__);
+            i++, count++
+        ) {
+            view = &self->writes[i];
+            iov[count].iov_base = view->buf;
+            iov[count].iov_len = view->len;
+            if (!count) {
+                iov[count].iov_base = (char *)view->buf + self->offset;
+                iov[count].iov_len -= self->offset;
+            }
+            size += iov[count].iov_len;
+        }
+        if ((zerocopy = (threshold && (size >= threshold)))) {
+            if (__Stream_reserve_completion__(self)) {
+                zerocopy = 0;
+            }
+        }
+        if ((n = self->ops->send(self, iov, count, &zerocopy)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            self->error = errno;
+            return 1;
+        }
+        __Stream_written__(self, __Stream_consume__(self, n), zerocopy);
+        if (n < size) {
+            break; // fd is full
+        }
+    }
+    if (!self->ops->flush) {
+        writing = (self->writes_head < self->writes_len);
+    }
+    else if ((writing = self->ops->flush(self)) < 0) {
+        self->error = errno;
+        return 1;
+    }
+    __Stream_set_writing__(self, writing);
+    return 0;
+}
+
+
+static int
+__Stream_pressure__(Stream *self)
+{
+    PyObject *paused = NULL, *result = NULL;
+
+    if (!self->paused && (self->buffered > self->high)) {
+        paused = Py_True;
+    }
+    else if (self->paused && (self->buffered <= self->low)) {
+        paused = Py_False;
+    }
+    else {
+        return 0;
+    }
+    self->paused = (paused == Py_True);
+    if (self->backpressure != Py_None) {
+        result = _Py_Invoke_Callback(self->backpressure, self, paused, NULL);
+        if (!result) {
+            return -1;
+        }
+        Py_DECREF(result);
+    }
+    return 0;
+}
+
+
+// flush at the end of this loop iteration (or when fd is writable), a
+// stopped stream is flushed when started
+static void
+__Stream_schedule__(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_io *io = (ev_io *)watcher->watcher;
+
+    if (ev_is_active(io) && !(io->events & EV_WRITE)) {
+        ev_prepare_start(watcher->loop->loop, self->prepare);
+    }
+}
+
+
+// steals the reference to view (even on error)
+static int
+__Stream_queue__(Stream *self, Py_buffer *view)
+{
+    if (__Stream_push__(self, view)) {
+        PyBuffer_Release(view);
+        return -1;
+    }
+    __Stream_schedule__(self);
+    return __Stream_pressure__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static void
+__Stream_invoke__(Stream *self, PyObject *arg)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (watcher->callback != Py_None) {
+        __Watcher_invoke_callback__(watcher, arg);
+    }
+}
+
+
+// end of stream: stop, drop what cannot be written and report
+static void
+__Stream_end__(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+    ev_loop *loop = watcher->loop->loop;
+
+    ev_prepare_stop(loop, self->prepare);
+    __ev_watcher_stop__(loop, watcher->watcher, watcher->ev_type);
+    if (self->completions_len) {
+        __Stream_complete__(self);
+    }
+    if (!self->error) {
+        // best effort (e.g. the peer only shut down its side), without zero
+        // copy as nothing will wait for the completion
+        if (!__Stream_flush__(self, 0) && self->ops->shutdown) {
+            self->ops->shutdown(self);
+        }
+    }
+    __Stream_drop_writes__(self);
+    __Stream_set_writing__(self, 0);
+    if (!PyErr_Occurred()) {
+        __Stream_invoke__(self, Py_None);
+    }
+}
+
+
+static void
+__Stream_writable__(Stream *self)
+{
+    ev_loop *loop = ((Watcher *)self)->loop->loop;
+
+    if (__Stream_flush__(self, self->zerocopy)) {
+        __Stream_end__(self);
+    }
+    else if (
+        __Stream_pressure__(self) &&
+        !ev_loop_defer(loop, (PyObject *)self, self->backpressure)
+    ) {
+        ev_loop_warn(loop, self->backpressure);
+    }
+}
+
+
+static void
+__ev_stream_flush__(ev_loop *loop, ev_prepare *prepare, int revents)
+{
+    Stream *self = prepare->data;
+
+    ev_prepare_stop(loop, prepare);
+    if (!ev_is_active(((Watcher *)self)->watcher)) {
+        return; // stopped since (e.g. by its callback return value)
+    }
+    __Stream_writable__(self);
+    if (PyErr_Occurred()) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+static void
+__ev_stream_invoke__(ev_loop *loop, ev_io *io, int revents)
+{
+    Watcher *self = io->data;
+    PyObject *frames = NULL;
+    int done = 0;
+
+    if ((revents & EV_ERROR) || self->loop->collecting) {
+        __ev_watcher_invoke__(loop, (ev_watcher *)io, revents);
+        return;
+    }
+    if (__Watcher_invoke_verify__(self)) {
+        goto end;
+    }
+    if (((Stream *)self)->zerocopy || ((Stream *)self)->completions_len) {
+        // completions show up as errors (i.e. EV_READ and EV_WRITE)
+        __Stream_complete__((Stream *)self);
+    }
+    if (revents & EV_WRITE) {
+        __Stream_writable__((Stream *)self);
+    }
+    if (
+        (revents & EV_READ) &&
+        ev_is_active(io) &&
+        ((done = __Stream_read__((Stream *)self)) >= 0) &&
+        (frames = __Stream_frames__((Stream *)self, &done))
+    ) {
+        if (((Stream *)self)->ops->flush && !done) {
+            // reading might have produced output (e.g. a handshake)
+            __Stream_schedule__((Stream *)self);
+        }
+        if (PyList_GET_SIZE(frames)) {
+            __Stream_invoke__((Stream *)self, frames);
+        }
+        Py_DECREF(frames);
+        if (done) {
+            __Stream_end__((Stream *)self);
+        }
+    }
+
+end:
+    if (
+        PyErr_Occurred() ||
+        (!self->loop->max_errors && PyErr_CheckSignals())
+    ) {
+        ev_loop_stop(loop);
+    }
+}
+
+
+/* --------------------------------------------------------------------------
+   Stream
+   -------------------------------------------------------------------------- */
+
+Stream *
+__Stream_alloc__(PyTypeObject *type)
+{
+    Stream *self = NULL;
+
+    if ((self = (Stream *)__Watcher_alloc__(type))) {
+        self->ops = &__Stream_ops__;
+        self->framer = NULL;
+        self->kind = 0;
+        self->prefix = 0;
+        self->little = 0;
+        self->fixed = 0;
+        self->scanned = 0;
+        self->data = NULL;
+        self->start = 0;
+        self->end = 0;
+        self->size = 0;
+        self->budget = __STREAM_BUDGET__;
+        self->max_size = __STREAM_MAX_SIZE__;
+        self->frame = NULL;
+        self->frame_len = 0;
+        self->exports = 0;
+        self->retired = NULL;
+        self->error = 0;
+        self->prepare = NULL;
+        self->writes = NULL;
+        self->writes_sent = 0;
+        self->writes_head = 0;
+        self->writes_len = 0;
+        self->writes_size = 0;
+        self->offset = 0;
+        self->buffered = 0;
+        self->high = __STREAM_HIGH__;
+        self->low = __STREAM_LOW__;
+        self->paused = 0;
+        self->backpressure = Py_NewRef(Py_None);
+        self->zerocopy = 0;
+        self->completions = NULL;
+        self->completions_head = 0;
+        self->completions_len = 0;
+        self->completions_size = 0;
+        self->zckey = 0;
+    }
+    return self;
+}
+
+
+int
+__Stream_post_alloc__(Stream *self, int ev_type, size_t size)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (__Watcher_post_alloc__(watcher, ev_type, size)) {
+        return -1;
+    }
+    if (!(self->prepare = PyMem_Malloc(sizeof(ev_prepare)))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->prepare->data = self;
+    ev_prepare_init(self->prepare, __ev_stream_flush__);
+    ev_set_cb(((ev_io *)watcher->watcher), __ev_stream_invoke__);
+    return 0;
+}
+
+
+void
+__Stream_finalize__(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    if (self->prepare && watcher->loop && watcher->loop->loop) {
+        ev_prepare_stop(watcher->loop->loop, self->prepare);
+    }
+    __Watcher_finalize__(watcher);
+}
+
+
+int
+__Stream_traverse__(Stream *self, visitproc visit, void *arg)
+{
+    Py_ssize_t i;
+
+    for (i = self->writes_sent; i < self->writes_len; i++) {
+        Py_VISIT(self->writes[i].obj);
+    }
+    Py_VISIT(self->backpressure);
+    Py_VISIT(self->framer);
+    return __Watcher_traverse__((Watcher *)self, visit, arg);
+}
+
+
+int
+__Stream_clear__(Stream *self)
+{
+    __Stream_clear_writes__(self);
+    Py_CLEAR(self->backpressure);
+    Py_CLEAR(self->framer);
+    return __Watcher_clear__((Watcher *)self);
+}
+
+
+void
+__Stream_dealloc__(Stream *self)
+{
+    if (self->writes) {
+        PyMem_Free(self->writes);
+        self->writes = NULL;
+    }
+    if (self->completions) {
+        PyMem_Free(self->completions);
+        self->completions = NULL;
+    }
+    if (self->prepare) {
+        PyMem_Free(self->prepare);
+        self->prepare = NULL;
+    }
+    // no frame can be exported anymore
+    __Stream_free_retired__(self);
+    if (self->data) {
+        PyMem_Free(self->data);
+        self->data = NULL;
+    }
+    __Watcher_dealloc__((Watcher *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Stream_Type.tp_dealloc */
+static void
+Stream_tp_dealloc(Stream *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    __Stream_clear__(self);
+    __Stream_dealloc__(self);
+}
+
+
+/* Stream_Type.tp_traverse */
+static int
+Stream_tp_traverse(Stream *self, visitproc visit, void *arg)
+{
+    return __Stream_traverse__(self, visit, arg);
+}
+
+
+/* Stream_Type.tp_clear */
+static int
+Stream_tp_clear(Stream *self)
+{
+    return __Stream_clear__(self);
+}
+
+
+/* Stream_Type.tp_init */
+static int
+Stream_tp_init(Stream *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd", "framer",
+        "callback", "data", "priority", NULL
+    };
+
+    Loop *loop = NULL;
+    PyObject *fd = NULL, *framer = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OOO|Oi:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd, &framer,
+            &callback, &data, &priority
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, EV_READ)
+    ) {
+        return -1;
+    }
+    return __Stream_set_framer__(self, framer);
+}
+
+
+/* Stream_Type.tp_new */
+static PyObject *
+Stream_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    Stream *self = NULL;
+
+    if ((self = __Stream_alloc__(type))) {
+        PyObject_GC_Track(self);
+        if (__Stream_post_alloc__(self, EV_IO, sizeof(ev_io))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Stream_Type.tp_finalize */
+static void
+Stream_tp_finalize(Stream *self)
+{
+    __Stream_finalize__(self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Stream_Type.tp_as_buffer.bf_getbuffer */
+static int
+Stream_bf_getbuffer(Stream *self, Py_buffer *view, int flags)
+{
+    if (!self->frame) {
+        PyErr_SetString(PyExc_BufferError, "no current frame");
+        view->obj = NULL;
+        return -1;
+    }
+    if (
+        PyBuffer_FillInfo(
+            view, (PyObject *)self, self->frame, self->frame_len, 1, flags
+        )
+    ) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+
+/* Stream_Type.tp_as_buffer.bf_releasebuffer */
+static void
+Stream_bf_releasebuffer(Stream *self, Py_buffer *view)
+{
+    if (!--self->exports) {
+        __Stream_free_retired__(self);
+    }
+}
+
+
+static PyBufferProcs Stream_tp_as_buffer = {
+    .bf_getbuffer = (getbufferproc)Stream_bf_getbuffer,
+    .bf_releasebuffer = (releasebufferproc)Stream_bf_releasebuffer,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Stream.write(buf) */
+static PyObject *
+Stream_write(Stream *self, PyObject *args)
+{
+    Py_buffer view;
+
+    if (!PyArg_ParseTuple(args, "y*:write", &view)) {
+        return NULL;
+    }
+    if (self->error) {
+        PyBuffer_Release(&view);
+        errno = self->error;
+        return _PyErr_SetFromErrno();
+    }
+    if (!view.len) {
+        PyBuffer_Release(&view);
+        Py_RETURN_NONE;
+    }
+    if (__Stream_queue__(self, &view)) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Stream.start() */
+static PyObject *
+Stream_start(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    __ev_watcher_start__(
+        watcher->loop->loop, watcher->watcher, watcher->ev_type
+    );
+    // flush what was written while stopped (or e.g. a TLS handshake)
+    if ((self->writes_head < self->writes_len) || self->ops->flush) {
+        __Stream_schedule__(self);
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Stream.stop() */
+static PyObject *
+Stream_stop(Stream *self)
+{
+    Watcher *watcher = (Watcher *)self;
+
+    ev_prepare_stop(watcher->loop->loop, self->prepare);
+    __ev_watcher_stop__(
+        watcher->loop->loop, watcher->watcher, watcher->ev_type
+    );
+    watcher->queued = 0;
+    Py_RETURN_NONE;
+}
+
+
+/* Stream_Type.tp_methods */
+static PyMethodDef Stream_tp_methods[] = {
+    {
+        "start",
+        (PyCFunction)Stream_start,
+        METH_NOARGS,
+        "start()"
+    },
+    {
+        "stop",
+        (PyCFunction)Stream_stop,
+        METH_NOARGS,
+        "stop()"
+    },
+    {
+        "write",
+        (PyCFunction)Stream_write,
+        METH_VARARGS,
+        "write(buf)"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Stream.framer */
+static PyObject *
+Stream_framer_getter(Stream *self, void *closure)
+{
+    return Py_NewRef(self->framer);
+}
+
+static int
+Stream_framer_setter(Stream *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Stream_set_framer__(self, value);
+}
+
+
+/* Stream.budget/Stream.max_size */
+static PyObject *
+Stream_size_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(closure ? self->max_size : self->budget);
+}
+
+static int
+Stream_size_setter(Stream *self, PyObject *value, void *closure)
+{
+    Py_ssize_t size = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((size = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (size <= 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be greater than 0");
+        return -1;
+    }
+    if (closure) {
+        self->max_size = size;
+    }
+    else {
+        self->budget = size;
+    }
+    return 0;
+}
+
+
+/* Stream.high_water/Stream.low_water */
+static PyObject *
+Stream_water_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(closure ? self->low : self->high);
+}
+
+static int
+Stream_water_setter(Stream *self, PyObject *value, void *closure)
+{
+    Py_ssize_t size = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((size = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return -1;
+    }
+    if (closure ? (size > self->high) : (size < self->low)) {
+        PyErr_SetString(
+            PyExc_ValueError, "low_water must be lower than high_water"
+        );
+        return -1;
+    }
+    if (closure) {
+        self->low = size;
+    }
+    else {
+        self->high = size;
+    }
+    return 0;
+}
+
+
+/* Stream.backpressure */
+static PyObject *
+Stream_backpressure_getter(Stream *self, void *closure)
+{
+    return Py_NewRef(self->backpressure);
+}
+
+static int
+Stream_backpressure_setter(Stream *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    _Py_CHECK_CALLABLE_OR_NONE(value, -1);
+    _Py_SET_MEMBER(self->backpressure, value);
+    return 0;
+}
+
+
+/* Stream.zerocopy */
+static PyObject *
+Stream_zerocopy_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->zerocopy);
+}
+
+static int
+Stream_zerocopy_setter(Stream *self, PyObject *value, void *closure)
+{
+    int fd = ((ev_io *)((Watcher *)self)->watcher)->fd, enable = 0;
+    Py_ssize_t size = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (value == Py_True) {
+        size = __STREAM_ZEROCOPY__;
+    }
+    else if (
+        ((size = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()
+    ) {
+        return -1;
+    }
+    if (size < 0) {
+        PyErr_SetString(PyExc_ValueError, "size must be positive");
+        return -1;
+    }
+    if ((enable = (size != 0)) != (self->zerocopy != 0)) {
+        if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &enable, sizeof(enable))) {
+            _PyErr_SetFromErrno();
+            return -1;
+        }
+    }
+    self->zerocopy = size;
+    return 0;
+}
+
+
+/* Stream.unacknowledged */
+static PyObject *
+Stream_unacknowledged_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->writes_head - self->writes_sent);
+}
+
+
+/* Stream.buffered */
+static PyObject *
+Stream_buffered_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->buffered);
+}
+
+
+/* Stream.pending */
+static PyObject *
+Stream_pending_getter(Stream *self, void *closure)
+{
+    return PyLong_FromSsize_t(__Stream_len__(self));
+}
+
+
+/* Stream.error */
+static PyObject *
+Stream_error_getter(Stream *self, void *closure)
+{
+    return PyLong_FromLong(self->error);
+}
+
+
+/* Stream_Type.tp_getsets */
+static PyGetSetDef Stream_tp_getsets[] = {
+    {
+        "framer",
+        (getter)Stream_framer_getter,
+        (setter)Stream_framer_setter,
+        NULL,
+        NULL
+    },
+    {
+        "budget",
+        (getter)Stream_size_getter,
+        (setter)Stream_size_setter,
+        NULL,
+        NULL
+    },
+    {
+        "max_size",
+        (getter)Stream_size_getter,
+        (setter)Stream_size_setter,
+        NULL,
+        Py_True
+    },
+    {
+        "high_water",
+        (getter)Stream_water_getter,
+        (setter)Stream_water_setter,
+        NULL,
+        NULL
+    },
+    {
+        "low_water",
+        (getter)Stream_water_getter,
+        (setter)Stream_water_setter,
+        NULL,
+        Py_True
+    },
+    {
+        "backpressure",
+        (getter)Stream_backpressure_getter,
+        (setter)Stream_backpressure_setter,
+        NULL,
+        NULL
+    },
+    {
+        "zerocopy",
+        (getter)Stream_zerocopy_getter,
+        (setter)Stream_zerocopy_setter,
+        NULL,
+        NULL
+    },
+    {
+        "unacknowledged",
+        (getter)Stream_unacknowledged_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "buffered",
+        (getter)Stream_buffered_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "pending",
+        (getter)Stream_pending_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "error",
+        (getter)Stream_error_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Stream_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Stream",
+    .tp_basicsize = sizeof(Stream),
+    .tp_dealloc = (destructor)Stream_tp_dealloc,
+    .tp_as_buffer = &Stream_tp_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "Stream(loop, fd, framer, callback[, data=None, priority=0])",
+    .tp_traverse = (traverseproc)Stream_tp_traverse,
+    .tp_clear = (inquiry)Stream_tp_clear,
+    .tp_methods = Stream_tp_methods,
+    .tp_getset = Stream_tp_getsets,
+    .tp_init = (initproc)Stream_tp_init,
+    .tp_new = (newfunc)Stream_tp_new,
+    .tp_finalize = (destructor)Stream_tp_finalize,
+};
+
+
+/* --------------------------------------------------------------------------
+   Broadcast
+   -------------------------------------------------------------------------- */
+
+static int
+__Broadcast_check__(PyObject *stream)
+{
+    if (!PyObject_TypeCheck(stream, &Stream_Type)) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "expected a Stream, not %.200s",
+            Py_TYPE(stream)->tp_name
+        );
+        return -1;
+    }
+    return 0;
+}
+
+
+// disconnect a slow subscriber
+static void
+__Broadcast_disconnect__(Stream *stream)
+{
+    Watcher *watcher = (Watcher *)stream;
+
+    if (!stream->error && watcher->loop) {
+        stream->error = ENOBUFS;
+        __Stream_end__(stream);
+    }
+}
+
+
+// returns 1 if stream must be unsubscribed, 2 if buf was dropped, -1 on error
+static int
+__Broadcast_send__(Broadcast *self, Stream *stream, PyObject *shared)
+{
+    Py_buffer view;
+
+    if (stream->error) {
+        return 1; // ended
+    }
+    if (PyObject_GetBuffer(shared, &view, PyBUF_SIMPLE)) {
+        return -1;
+    }
+    if (self->limit && ((stream->buffered + view.len) > self->limit)) {
+        PyBuffer_Release(&view);
+        self->dropped++;
+        return self->disconnect ? 1 : 2;
+    }
+    return (__Stream_queue__(stream, &view)) ? -1 : 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Broadcast_Type.tp_new */
+static PyObject *
+Broadcast_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    Broadcast *self = NULL;
+
+    if ((self = PyObject_GC_NEW(Broadcast, type))) {
+        self->limit = 0;
+        self->disconnect = 0;
+        self->dropped = 0;
+        if (!(self->subscribers = PyDict_New())) {
+            Py_CLEAR(self);
+        }
+        else {
+            PyObject_GC_Track(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* Broadcast.policy */
+static int
+__Broadcast_set_policy__(Broadcast *self, PyObject *policy)
+{
+    const char *name = NULL;
+
+    if (!PyUnicode_Check(policy)) {
+        PyErr_Format(
+            PyExc_TypeError,
+            "policy must be a str, not %.200s",
+            Py_TYPE(policy)->tp_name
+        );
+        return -1;
+    }
+    if (!(name = PyUnicode_AsUTF8(policy))) {
+        return -1;
+    }
+    if (!strcmp(name, "drop")) {
+        self->disconnect = 0;
+    }
+    else if (!strcmp(name, "disconnect")) {
+        self->disconnect = 1;
+    }
+    else {
+        PyErr_Format(PyExc_ValueError, "unknown policy: %R", policy);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Broadcast_Type.tp_init */
+static int
+Broadcast_tp_init(Broadcast *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {"limit", "policy", NULL};
+
+    Py_ssize_t limit = 0;
+    PyObject *policy = NULL;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "|nO:__init__", kwlist, &limit, &policy
+        ) ||
+        (policy && __Broadcast_set_policy__(self, policy))
+    ) {
+        return -1;
+    }
+    if (limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "limit must be positive");
+        return -1;
+    }
+    self->limit = limit;
+    return 0;
+}
+
+
+/* Broadcast_Type.tp_traverse */
+static int
+Broadcast_tp_traverse(Broadcast *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->subscribers);
+    return 0;
+}
+
+
+/* Broadcast_Type.tp_clear */
+static int
+Broadcast_tp_clear(Broadcast *self)
+{
+    Py_CLEAR(self->subscribers);
+    return 0;
+}
+
+
+/* Broadcast_Type.tp_dealloc */
+static void
+Broadcast_tp_dealloc(Broadcast *self)
+{
+    PyObject_GC_UnTrack(self);
+    Broadcast_tp_clear(self);
+    PyObject_GC_Del(self);
+}
+
+
+/* Broadcast_Type.tp_as_sequence.sq_length */
+static Py_ssize_t
+Broadcast_sq_length(Broadcast *self)
+{
+    return PyDict_GET_SIZE(self->subscribers);
+}
+
+
+static PySequenceMethods Broadcast_tp_as_sequence = {
+    .sq_length = (lenfunc)Broadcast_sq_length,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Broadcast.subscribe(stream) */
+static PyObject *
+Broadcast_subscribe(Broadcast *self, PyObject *stream)
+{
+    if (
+        __Broadcast_check__(stream) ||
+        PyDict_SetItem(self->subscribers, stream, Py_None)
+    ) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Broadcast.unsubscribe(stream) */
+static PyObject *
+Broadcast_unsubscribe(Broadcast *self, PyObject *stream)
+{
+    if (
+        __Broadcast_check__(stream) ||
+        PyDict_DelItem(self->subscribers, stream)
+    ) {
+        return NULL;
+    }
+    Py_RETURN_NONE;
+}
+
+
+/* Broadcast.publish(buf) */
+static PyObject *
+Broadcast_publish(Broadcast *self, PyObject *buf)
+{
+    PyObject *shared = NULL, *streams = NULL, *removed = NULL;
+    Py_ssize_t i, count = 0;
+    int result = 0;
+
+    // one export of buf, shared by all the write queues
+    if (
+        !(shared = PyMemoryView_FromObject(buf)) ||
+        !(streams = PyDict_Keys(self->subscribers)) ||
+        !(removed = PyList_New(0))
+    ) {
+        goto fail;
+    }
+    // callbacks (backpressure) may change subscribers, work on a snapshot
+    for (i = 0; i < PyList_GET_SIZE(streams); i++) {
+        if (
+            (result = __Broadcast_send__(
+                self, (Stream *)PyList_GET_ITEM(streams, i), shared
+            )) < 0
+        ) {
+            goto fail;
+        }
+        if (!result) {
+            count++;
+        }
+        else if (
+            (result == 1) &&
+            PyList_Append(removed, PyList_GET_ITEM(streams, i))
+        ) {
+            goto fail;
+        }
+    }
+    for (i = 0; i < PyList_GET_SIZE(removed); i++) {
+        // might already be gone
+        if (
+            PyDict_DelItem(self->subscribers, PyList_GET_ITEM(removed, i)) &&
+            !PyErr_ExceptionMatches(PyExc_KeyError)
+        ) {
+            goto fail;
+        }
+        PyErr_Clear();
+        __Broadcast_disconnect__((Stream *)PyList_GET_ITEM(removed, i));
+        if (PyErr_Occurred()) {
+            goto fail;
+        }
+    }
+    Py_DECREF(removed);
+    Py_DECREF(streams);
+    Py_DECREF(shared);
+    return PyLong_FromSsize_t(count);
+
+fail:
+    Py_XDECREF(removed);
+    Py_XDECREF(streams);
+    Py_XDECREF(shared);
+    return NULL;
+}
+
+
+/* Broadcast_Type.tp_methods */
+static PyMethodDef Broadcast_tp_methods[] = {
+    {
+        "subscribe",
+        (PyCFunction)Broadcast_subscribe,
+        METH_O,
+        "subscribe(stream)"
+    },
+    {
+        "unsubscribe",
+        (PyCFunction)Broadcast_unsubscribe,
+        METH_O,
+        "unsubscribe(stream)"
+    },
+    {
+        "publish",
+        (PyCFunction)Broadcast_publish,
+        METH_O,
+        "publish(buf) -> int"
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Broadcast.limit */
+static PyObject *
+Broadcast_limit_getter(Broadcast *self, void *closure)
+{
+    return PyLong_FromSsize_t(self->limit);
+}
+
+static int
+Broadcast_limit_setter(Broadcast *self, PyObject *value, void *closure)
+{
+    Py_ssize_t limit = -1;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (((limit = PyLong_AsSsize_t(value)) == -1) && PyErr_Occurred()) {
+        return -1;
+    }
+    if (limit < 0) {
+        PyErr_SetString(PyExc_ValueError, "limit must be positive");
+        return -1;
+    }
+    self->limit = limit;
+    return 0;
+}
+
+
+/* Broadcast.policy */
+static PyObject *
+Broadcast_policy_getter(Broadcast *self, void *closure)
+{
+    return PyUnicode_FromString(self->disconnect ? "disconnect" : "drop");
+}
+
+static int
+Broadcast_policy_setter(Broadcast *self, PyObject *value, void *closure)
+{
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    return __Broadcast_set_policy__(self, value);
+}
+
+
+/* Broadcast.dropped */
+static PyObject *
+Broadcast_dropped_getter(Broadcast *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->dropped);
+}
+
+
+/* Broadcast_Type.tp_getsets */
+static PyGetSetDef Broadcast_tp_getsets[] = {
+    {
+        "limit",
+        (getter)Broadcast_limit_getter,
+        (setter)Broadcast_limit_setter,
+        NULL,
+        NULL
+    },
+    {
+        "policy",
+        (getter)Broadcast_policy_getter,
+        (setter)Broadcast_policy_setter,
+        NULL,
+        NULL
+    },
+    {
+        "dropped",
+        (getter)Broadcast_dropped_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject Broadcast_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.Broadcast",
+    .tp_basicsize = sizeof(Broadcast),
+    .tp_dealloc = (destructor)Broadcast_tp_dealloc,
+    .tp_as_sequence = &Broadcast_tp_as_sequence,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC,
+    .tp_doc = "Broadcast([limit=0, policy='drop'])",
+    .tp_traverse = (traverseproc)Broadcast_tp_traverse,
+    .tp_clear = (inquiry)Broadcast_tp_clear,
+    .tp_methods = Broadcast_tp_methods,
+    .tp_getset = Broadcast_tp_getsets,
+    .tp_init = (initproc)Broadcast_tp_init,
+    .tp_new = (newfunc)Broadcast_tp_new,
+};
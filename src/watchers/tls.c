@@ -0,0 +1,774 @@
+#include "watcher.h"
+
+#include <openssl/err.h>
+#include <unistd.h>
+
+
+/* helpers ------------------------------------------------------------------ */
+
+#define __TLS_BIO_SIZE__ 65536
+#define __TLS_WRITE_MAX__ (4 * __TLS_BIO_SIZE__)
+
+
+#define __TLS_clear__() \
+    do { \
+        ERR_clear_error(); \
+        errno = 0; \
+    } while (0)
+
+
+static PyObject *
+__TLS_error__(const char *message)
+{
+    unsigned long error = ERR_get_error();
+    char reason[256];
+
+    ERR_clear_error();
+    if (error) {
+        ERR_error_string_n(error, reason, sizeof(reason));
+        PyErr_Format(EventError, "%s: %s", message, reason);
+    }
+    else {
+        PyErr_SetString(EventError, message);
+    }
+    return NULL;
+}
+
+
+/* --------------------------------------------------------------------------
+   TLSContext
+   -------------------------------------------------------------------------- */
+
+static int
+__TLSContext_load__(
+    TLSContext *self, PyObject *certfile, PyObject *keyfile, PyObject *cafile
+)
+{
+    PyObject *cert = NULL, *key = NULL, *ca = NULL;
+    int result = -1, mode = SSL_VERIFY_PEER;
+
+    if (
+        ((certfile != Py_None) && !PyUnicode_FSConverter(certfile, &cert)) ||
+        ((keyfile != Py_None) && !PyUnicode_FSConverter(keyfile, &key)) ||
+        ((cafile != Py_None) && !PyUnicode_FSConverter(cafile, &ca))
+    ) {
+        goto end;
+    }
+    if (
+        cert &&
+        (
+            (SSL_CTX_use_certificate_chain_file(
+                self->ctx, PyBytes_AS_STRING(cert)
+            ) != 1) ||
+            (SSL_CTX_use_PrivateKey_file(
+                self->ctx,
+                PyBytes_AS_STRING(key ? key : cert),
+                SSL_FILETYPE_PEM
+            ) != 1) ||
+            (SSL_CTX_check_private_key(self->ctx) != 1)
+        )
+    ) {
+        __TLS_error__("cannot load certificate");
+        goto end;
+    }
+    if (ca) {
+        if (
+            SSL_CTX_load_verify_locations(
+                self->ctx, PyBytes_AS_STRING(ca), NULL
+            ) != 1
+        ) {
+            __TLS_error__("cannot load cafile");
+            goto end;
+        }
+        if (self->server_side) {
+            mode |= SSL_VERIFY_FAIL_IF_NO_PEER_CERT;
+        }
+        SSL_CTX_set_verify(self->ctx, mode, NULL);
+    }
+    else if (!self->server_side) {
+        if (SSL_CTX_set_default_verify_paths(self->ctx) != 1) {
+            __TLS_error__("cannot load default verify paths");
+            goto end;
+        }
+        SSL_CTX_set_verify(self->ctx, mode, NULL);
+    }
+    result = 0;
+
+end:
+    Py_XDECREF(ca);
+    Py_XDECREF(key);
+    Py_XDECREF(cert);
+    return result;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* TLSContext_Type.tp_new */
+static PyObject *
+TLSContext_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    TLSContext *self = NULL;
+
+    if ((self = (TLSContext *)type->tp_alloc(type, 0))) {
+        self->ctx = NULL;
+        self->server_side = 0;
+    }
+    return (PyObject *)self;
+}
+
+
+/* TLSContext_Type.tp_init */
+static int
+TLSContext_tp_init(TLSContext *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "server_side", "certfile", "keyfile", "cafile", NULL
+    };
+
+    int server_side = 0;
+    PyObject *certfile = Py_None, *keyfile = Py_None, *cafile = Py_None;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "p|OOO:__init__", kwlist,
+            &server_side, &certfile, &keyfile, &cafile
+        )
+    ) {
+        return -1;
+    }
+    if (self->ctx) {
+        SSL_CTX_free(self->ctx);
+    }
+    if (
+        !(self->ctx = SSL_CTX_new(
+            server_side ? TLS_server_method() : TLS_client_method()
+        ))
+    ) {
+        __TLS_error__("cannot create context");
+        return -1;
+    }
+    self->server_side = server_side;
+    SSL_CTX_set_min_proto_version(self->ctx, TLS1_2_VERSION);
+    SSL_CTX_set_mode(
+        self->ctx,
+        SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+    );
+    return __TLSContext_load__(self, certfile, keyfile, cafile);
+}
+
+
+/* TLSContext_Type.tp_dealloc */
+static void
+TLSContext_tp_dealloc(TLSContext *self)
+{
+    if (self->ctx) {
+        SSL_CTX_free(self->ctx);
+        self->ctx = NULL;
+    }
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* TLSContext.server_side */
+static PyObject *
+TLSContext_server_side_getter(TLSContext *self, void *closure)
+{
+    return PyBool_FromLong(self->server_side);
+}
+
+
+/* TLSContext_Type.tp_getsets */
+static PyGetSetDef TLSContext_tp_getsets[] = {
+    {
+        "server_side",
+        (getter)TLSContext_server_side_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject TLSContext_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.TLSContext",
+    .tp_basicsize = sizeof(TLSContext),
+    .tp_dealloc = (destructor)TLSContext_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+    .tp_doc = "TLSContext(server_side[, certfile=None, keyfile=None, cafile=None])",
+    .tp_getset = TLSContext_tp_getsets,
+    .tp_init = (initproc)TLSContext_tp_init,
+    .tp_new = (newfunc)TLSContext_tp_new,
+};
+
+
+/* --------------------------------------------------------------------------
+   TLSStream
+   -------------------------------------------------------------------------- */
+
+#define __TLSStream_fd__(S) (((ev_io *)((Watcher *)(S))->watcher)->fd)
+
+
+// returns SSL_ERROR_WANT_READ/WANT_WRITE (errno is EAGAIN),
+// SSL_ERROR_ZERO_RETURN (closed with close_notify) or -1 (see errno)
+static int
+__TLSStream_error__(TLSStream *self, int result)
+{
+    switch ((result = SSL_get_error(self->ssl, result))) {
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return result;
+        case SSL_ERROR_ZERO_RETURN:
+            return result;
+        case SSL_ERROR_SYSCALL:
+            if (!errno) { // eof without close_notify, might be truncated
+                errno = ECONNRESET;
+            }
+            return -1;
+        default:
+            if (
+                ERR_GET_REASON(ERR_peek_last_error()) ==
+                SSL_R_UNEXPECTED_EOF_WHILE_READING
+            ) {
+                errno = ECONNRESET;
+            }
+            else {
+                errno = EPROTO;
+            }
+            return -1;
+    }
+}
+
+
+// read ciphertext from fd into the bio pair, read(2) semantics
+static ssize_t
+__TLSStream_fill__(TLSStream *self)
+{
+    char *buf = NULL;
+    int size = 0;
+    ssize_t n = -1;
+
+    if ((size = BIO_nwrite0(self->network, &buf)) <= 0) {
+        errno = EAGAIN; // ssl has not consumed what is there yet
+        return -1;
+    }
+    do {
+        n = read(__TLSStream_fd__(self), buf, size);
+    } while ((n < 0) && (errno == EINTR));
+    if (n > 0) {
+        BIO_nwrite(self->network, &buf, n);
+    }
+    return n;
+}
+
+
+// write ciphertext from the bio pair to fd, returns -1 on error
+static int
+__TLSStream_drain__(TLSStream *self)
+{
+    char *buf = NULL;
+    int size = 0;
+    ssize_t n = -1;
+
+    while ((size = BIO_nread0(self->network, &buf)) > 0) {
+        if ((n = write(__TLSStream_fd__(self), buf, size)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                break;
+            }
+            return -1;
+        }
+        BIO_nread(self->network, &buf, n);
+        if (n < size) {
+            break; // fd is full
+        }
+    }
+    return 0;
+}
+
+
+#define __TLSStream_pending__(S) \
+    (!(S)->ktls && (BIO_ctrl_pending((S)->network) > 0))
+
+
+/* -------------------------------------------------------------------------- */
+
+/* StreamOps.recv */
+static ssize_t
+__TLSStream_recv__(Stream *stream, char *buf, size_t size)
+{
+    TLSStream *self = (TLSStream *)stream;
+    size_t total = 0, n = 0;
+    ssize_t filled = 0;
+    int result = 0;
+
+    while (total < size) {
+        __TLS_clear__();
+        if (SSL_read_ex(self->ssl, buf + total, size - total, &n)) {
+            total += n;
+            continue;
+        }
+        if ((result = __TLSStream_error__(self, 0)) == SSL_ERROR_ZERO_RETURN) {
+            return total;
+        }
+        if ((result == SSL_ERROR_WANT_READ) && !self->ktls) {
+            if ((filled = __TLSStream_fill__(self)) > 0) {
+                continue;
+            }
+            if (!filled) {
+                // eof without close_notify, might be truncated
+                errno = ECONNRESET;
+            }
+        }
+        break;
+    }
+    // errno is set if nothing was read
+    return total ? (ssize_t)total : -1;
+}
+
+
+/* StreamOps.send */
+static ssize_t
+__TLSStream_send__(Stream *stream, struct iovec *iov, int count, int *zc)
+{
+    TLSStream *self = (TLSStream *)stream;
+    size_t total = 0, done = 0, n = 0, pending = 0;
+    int i = 0, result = 0;
+
+    *zc = 0; // records are encrypted in user space
+    while ((i < count) && (total < __TLS_WRITE_MAX__)) {
+        __TLS_clear__();
+        if (
+            SSL_write_ex(
+                self->ssl,
+                (char *)iov[i].iov_base + done, iov[i].iov_len - done,
+                &n
+            )
+        ) {
+            self->want = 0;
+            total += n;
+            if ((done += n) == iov[i].iov_len) {
+                done = 0;
+                i++;
+            }
+            continue;
+        }
+        if ((result = __TLSStream_error__(self, 0)) == SSL_ERROR_ZERO_RETURN) {
+            errno = EPIPE;
+            result = -1;
+        }
+        if (result < 0) {
+            if (total) {
+                break; // reported on the next round
+            }
+            return -1;
+        }
+        self->want = result;
+        if (
+            (result == SSL_ERROR_WANT_WRITE) &&
+            ((pending = __TLSStream_pending__(self)))
+        ) {
+            // the bio pair is full, make room
+            if (__TLSStream_drain__(self)) {
+                return total ? (ssize_t)total : -1;
+            }
+            if ((size_t)BIO_ctrl_pending(self->network) < pending) {
+                continue;
+            }
+        }
+        break;
+    }
+    if (__TLSStream_pending__(self) && __TLSStream_drain__(self) && !total) {
+        return -1;
+    }
+    if (!total) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return total;
+}
+
+
+/* StreamOps.flush */
+static int
+__TLSStream_flush__(Stream *stream)
+{
+    TLSStream *self = (TLSStream *)stream;
+    int result = 0;
+
+    if (!SSL_is_init_finished(self->ssl)) {
+        __TLS_clear__();
+        if ((result = SSL_do_handshake(self->ssl)) == 1) {
+            self->want = 0;
+        }
+        else if (
+            (result = __TLSStream_error__(self, result)) ==
+            SSL_ERROR_ZERO_RETURN
+        ) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        else if (result < 0) {
+            return -1;
+        }
+        else {
+            self->want = result;
+        }
+    }
+    if (__TLSStream_pending__(self) && __TLSStream_drain__(self)) {
+        return -1;
+    }
+    return (
+        __TLSStream_pending__(self) ||
+        (self->want == SSL_ERROR_WANT_WRITE) ||
+        (
+            (stream->writes_head < stream->writes_len) &&
+            (self->want != SSL_ERROR_WANT_READ)
+        )
+    );
+}
+
+
+/* StreamOps.buffered */
+static int
+__TLSStream_buffered__(Stream *stream)
+{
+    TLSStream *self = (TLSStream *)stream;
+
+    return (
+        SSL_has_pending(self->ssl) ||
+        (!self->ktls && (BIO_ctrl_pending(SSL_get_rbio(self->ssl)) > 0))
+    );
+}
+
+
+/* StreamOps.shutdown */
+static void
+__TLSStream_shutdown__(Stream *stream)
+{
+    TLSStream *self = (TLSStream *)stream;
+
+    // best effort, let the peer know the stream was not truncated
+    if (SSL_is_init_finished(self->ssl)) {
+        __TLS_clear__();
+        SSL_shutdown(self->ssl);
+        if (__TLSStream_pending__(self)) {
+            __TLSStream_drain__(self);
+        }
+        __TLS_clear__();
+    }
+}
+
+
+static const StreamOps __TLSStream_ops__ = {
+    .recv = __TLSStream_recv__,
+    .send = __TLSStream_send__,
+    .flush = __TLSStream_flush__,
+    .buffered = __TLSStream_buffered__,
+    .shutdown = __TLSStream_shutdown__,
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+static void
+__TLSStream_free__(TLSStream *self)
+{
+    if (self->ssl) {
+        SSL_free(self->ssl); // frees the internal bio
+        self->ssl = NULL;
+    }
+    if (self->network) {
+        BIO_free(self->network);
+        self->network = NULL;
+    }
+}
+
+
+static int
+__TLSStream_set__(
+    TLSStream *self, TLSContext *context, PyObject *hostname, int check,
+    int ktls
+)
+{
+    const char *name = NULL;
+    BIO *internal = NULL;
+
+    if (!context->ctx) {
+        PyErr_SetString(EventError, "uninitialized context");
+        return -1;
+    }
+    if ((hostname != Py_None) && !(name = PyUnicode_AsUTF8(hostname))) {
+        return -1;
+    }
+    if (
+        !context->server_side &&
+        check &&
+        !name &&
+        (SSL_CTX_get_verify_mode(context->ctx) & SSL_VERIFY_PEER)
+    ) {
+        // any valid certificate would do, i.e. no protection against mitm
+        PyErr_SetString(
+            PyExc_ValueError,
+            "server_hostname is required when check_hostname is True"
+        );
+        return -1;
+    }
+    __TLSStream_free__(self);
+    if (!(self->ssl = SSL_new(context->ctx))) {
+        __TLS_error__("cannot create connection");
+        return -1;
+    }
+    if (ktls) {
+        // the kernel can only take over if ssl talks to the socket itself
+        SSL_set_options(self->ssl, SSL_OP_ENABLE_KTLS);
+        if (!SSL_set_fd(self->ssl, __TLSStream_fd__(self))) {
+            __TLS_error__("cannot set fd");
+            return -1;
+        }
+    }
+    else {
+        if (
+            !BIO_new_bio_pair(
+                &internal, __TLS_BIO_SIZE__, &self->network, __TLS_BIO_SIZE__
+            )
+        ) {
+            __TLS_error__("cannot create bio pair");
+            return -1;
+        }
+        SSL_set_bio(self->ssl, internal, internal);
+    }
+    if (context->server_side) {
+        SSL_set_accept_state(self->ssl);
+    }
+    else {
+        SSL_set_connect_state(self->ssl);
+        // sni is always sent, the certificate is only checked if asked to
+        if (
+            name &&
+            (
+                !SSL_set_tlsext_host_name(self->ssl, name) ||
+                (check && !SSL_set1_host(self->ssl, name))
+            )
+        ) {
+            __TLS_error__("cannot set server_hostname");
+            return -1;
+        }
+    }
+    _Py_SET_MEMBER(self->context, (PyObject *)context);
+    self->ktls = ktls;
+    self->want = 0;
+    return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* TLSStream_Type.tp_dealloc */
+static void
+TLSStream_tp_dealloc(TLSStream *self)
+{
+    if (PyObject_CallFinalizerFromDealloc((PyObject *)self)) {
+        return;
+    }
+    PyObject_GC_UnTrack(self);
+    Py_CLEAR(self->context);
+    __Stream_clear__((Stream *)self);
+    __TLSStream_free__(self);
+    __Stream_dealloc__((Stream *)self);
+}
+
+
+/* TLSStream_Type.tp_traverse */
+static int
+TLSStream_tp_traverse(TLSStream *self, visitproc visit, void *arg)
+{
+    Py_VISIT(self->context);
+    return __Stream_traverse__((Stream *)self, visit, arg);
+}
+
+
+/* TLSStream_Type.tp_clear */
+static int
+TLSStream_tp_clear(TLSStream *self)
+{
+    Py_CLEAR(self->context);
+    return __Stream_clear__((Stream *)self);
+}
+
+
+/* TLSStream_Type.tp_init */
+static int
+TLSStream_tp_init(TLSStream *self, PyObject *args, PyObject *kwargs)
+{
+    static char *kwlist[] = {
+        "loop",
+        "fd", "framer", "context",
+        "callback", "data", "priority",
+        "server_hostname", "ktls", "check_hostname", NULL
+    };
+
+    Stream *stream = (Stream *)self;
+    Loop *loop = NULL;
+    PyObject *fd = NULL, *framer = NULL;
+    TLSContext *context = NULL;
+    PyObject *callback = NULL, *data = Py_None;
+    int priority = 0;
+    PyObject *hostname = Py_None;
+    int ktls = 0, check = 1;
+
+    if (
+        !PyArg_ParseTupleAndKeywords(
+            args, kwargs, "O!OOO!O|OiOpp:__init__", kwlist,
+            &Loop_Type, &loop,
+            &fd, &framer, &TLSContext_Type, &context,
+            &callback, &data, &priority,
+            &hostname, &ktls, &check
+        ) ||
+        Watcher_init((Watcher *)self, loop, callback, data, priority) ||
+        __Io_set__((Watcher *)self, fd, EV_READ) ||
+        __Stream_set_framer__(stream, framer) ||
+        __TLSStream_set__(self, context, hostname, check, ktls)
+    ) {
+        return -1;
+    }
+    // the client hello is sent when started (see Stream.start())
+    return 0;
+}
+
+
+/* TLSStream_Type.tp_new */
+static PyObject *
+TLSStream_tp_new(PyTypeObject *type, PyObject *args, PyObject *kwargs)
+{
+    TLSStream *self = NULL;
+
+    if ((self = (TLSStream *)__Stream_alloc__(type))) {
+        ((Stream *)self)->ops = &__TLSStream_ops__;
+        self->context = NULL;
+        self->ssl = NULL;
+        self->network = NULL;
+        self->ktls = 0;
+        self->want = 0;
+        PyObject_GC_Track(self);
+        if (__Stream_post_alloc__((Stream *)self, EV_IO, sizeof(ev_io))) {
+            Py_CLEAR(self);
+        }
+    }
+    return (PyObject *)self;
+}
+
+
+/* TLSStream_Type.tp_finalize */
+static void
+TLSStream_tp_finalize(TLSStream *self)
+{
+    __Stream_finalize__((Stream *)self);
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* TLSStream.handshake */
+static PyObject *
+TLSStream_handshake_getter(TLSStream *self, void *closure)
+{
+    return PyBool_FromLong(self->ssl && SSL_is_init_finished(self->ssl));
+}
+
+
+/* TLSStream.version */
+static PyObject *
+TLSStream_version_getter(TLSStream *self, void *closure)
+{
+    if (!self->ssl || !SSL_is_init_finished(self->ssl)) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_FromString(SSL_get_version(self->ssl));
+}
+
+
+/* TLSStream.cipher */
+static PyObject *
+TLSStream_cipher_getter(TLSStream *self, void *closure)
+{
+    if (!self->ssl || !SSL_is_init_finished(self->ssl)) {
+        Py_RETURN_NONE;
+    }
+    return PyUnicode_FromString(SSL_get_cipher_name(self->ssl));
+}
+
+
+/* TLSStream.ktls */
+static PyObject *
+TLSStream_ktls_getter(TLSStream *self, void *closure)
+{
+    int send = 0, recv = 0;
+
+    if (self->ssl && self->ktls) {
+        send = BIO_get_ktls_send(SSL_get_wbio(self->ssl));
+        recv = BIO_get_ktls_recv(SSL_get_rbio(self->ssl));
+    }
+    return Py_BuildValue("(NN)", PyBool_FromLong(send), PyBool_FromLong(recv));
+}
+
+
+/* TLSStream_Type.tp_getsets */
+static PyGetSetDef TLSStream_tp_getsets[] = {
+    {
+        "handshake",
+        (getter)TLSStream_handshake_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "version",
+        (getter)TLSStream_version_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "cipher",
+        (getter)TLSStream_cipher_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {
+        "ktls",
+        (getter)TLSStream_ktls_getter,
+        _Py_READONLY_ATTRIBUTE,
+        NULL,
+        NULL
+    },
+    {NULL}
+};
+
+
+/* -------------------------------------------------------------------------- */
+
+PyTypeObject TLSStream_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.TLSStream",
+    .tp_basicsize = sizeof(TLSStream),
+    .tp_dealloc = (destructor)TLSStream_tp_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_HAVE_FINALIZE,
+    .tp_doc = "TLSStream(loop, fd, framer, context, callback[, data=None, priority=0, server_hostname=None, ktls=False, check_hostname=True])",
+    .tp_traverse = (traverseproc)TLSStream_tp_traverse,
+    .tp_clear = (inquiry)TLSStream_tp_clear,
+    .tp_getset = TLSStream_tp_getsets,
+    .tp_init = (initproc)TLSStream_tp_init,
+    .tp_new = (newfunc)TLSStream_tp_new,
+    .tp_finalize = (destructor)TLSStream_tp_finalize,
+};
@@ -1,5 +1,7 @@
 #include "watcher.h"
 
+#include <math.h>
+
 
 /* helpers ------------------------------------------------------------------ */
 
@@ -8,7 +10,7 @@
 #define __ev_watcher_call_stop__(t, l, w) __ev_watcher_call__(stop, t, l, w)
 
 
-static void
+void
 __ev_watcher_start__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 {
     switch (ev_type) {
@@ -35,6 +37,10 @@ __ev_watcher_start__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 #endif
 #if EV_IDLE_ENABLE
         case EV_IDLE:
+            if (!ev_is_active(watcher)) {
+                // see __Loop_work__()
+                ((Loop *)ev_userdata(loop))->idles++;
+            }
             __ev_watcher_call_start__(ev_idle, loop, watcher);
             break;
 #endif
@@ -45,6 +51,10 @@ __ev_watcher_start__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 #endif
 #if EV_CHECK_ENABLE
         case EV_CHECK:
+            if (!ev_is_active(watcher)) {
+                // see __Loop_work__()
+                ((Loop *)ev_userdata(loop))->checks++;
+            }
             __ev_watcher_call_start__(ev_check, loop, watcher);
             break;
 #endif
@@ -70,7 +80,7 @@ __ev_watcher_start__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 }
 
 
-static void
+void
 __ev_watcher_stop__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 {
     switch (ev_type) {
@@ -97,6 +107,9 @@ __ev_watcher_stop__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 #endif
 #if EV_IDLE_ENABLE
         case EV_IDLE:
+            if (ev_is_active(watcher)) {
+                ((Loop *)ev_userdata(loop))->idles--;
+            }
             __ev_watcher_call_stop__(ev_idle, loop, watcher);
             break;
 #endif
@@ -107,6 +120,9 @@ __ev_watcher_stop__(ev_loop *loop, ev_watcher *watcher, int ev_type)
 #endif
 #if EV_CHECK_ENABLE
         case EV_CHECK:
+            if (ev_is_active(watcher)) {
+                ((Loop *)ev_userdata(loop))->checks--;
+            }
             __ev_watcher_call_stop__(ev_check, loop, watcher);
             break;
 #endif
@@ -145,11 +161,123 @@ __Watcher_warn__(Watcher *self)
 }
 
 
-static void
+int
+__Watcher_invoke_verify__(Watcher *self)
+{
+    // when errors are deferred, signals are checked once per iteration
+    if (self->loop->max_errors && !PyErr_Occurred()) {
+        return 0;
+    }
+    return _Py_Invoke_Verify(self->callback, "watcher callback");
+}
+
+
+static int
+__Watcher_invalid_result__(PyObject *result)
+{
+    PyErr_Format(PyExc_ValueError, "invalid callback return value: %R", result);
+    return -1;
+}
+
+
+// STOP goes through the type's stop(), it may have more than ev_TYPE_stop to do
+static int
+__Watcher_stop_from_result__(Watcher *self)
+{
+    _Py_IDENTIFIER(stop);
+    PyObject *name = NULL, *result = NULL;
+
+    if (
+        !(name = _PyUnicode_FromId(&PyId_stop)) ||
+        !(result = PyObject_CallMethodNoArgs((PyObject *)self, name))
+    ) {
+        return -1;
+    }
+    Py_DECREF(result);
+    return 0;
+}
+
+
+// callback return value protocol, saves a round trip through Python
+static int
+__Watcher_apply_result__(Watcher *self, PyObject *result)
+{
+    ev_loop *loop = self->loop->loop;
+    int active = ev_is_active(self->watcher);
+    // watchers with a C handler (Stream, Listener, etc.) manage their own
+    // events and timers
+    int custom = (ev_cb(self->watcher) != __ev_watcher_invoke__);
+    int code = EVCB_KEEP;
+    double delay = 0.0;
+
+    if (
+        PyFloat_CheckExact(result) &&
+        (self->ev_type == EV_TIMER) &&
+        !custom
+    ) {
+        if (!isfinite((delay = PyFloat_AS_DOUBLE(result))) || (delay < 0.0)) {
+            return __Watcher_invalid_result__(result);
+        }
+        // re-arm the timer with a new delay
+        ev_timer_stop(loop, ((ev_timer *)self->watcher));
+        ev_timer_set(
+            ((ev_timer *)self->watcher),
+            delay,
+            ((ev_timer *)self->watcher)->repeat
+        );
+        ev_timer_start(loop, ((ev_timer *)self->watcher));
+        return 0;
+    }
+    if (Py_TYPE(result) != &CallbackResult_Type) {
+        return 0; // anything else is ignored
+    }
+    if ((code = ((CallbackResult *)result)->code) == EVCB_KEEP) {
+        return 0;
+    }
+    if (code == EVCB_STOP) {
+        return __Watcher_stop_from_result__(self);
+    }
+    if ((self->ev_type != EV_IO) || custom) {
+        return __Watcher_invalid_result__(result);
+    }
+    // switch the io interest
+    if ((((ev_io *)self->watcher)->events & (EV_READ | EV_WRITE)) != code) {
+        if (active) {
+            ev_io_stop(loop, ((ev_io *)self->watcher));
+        }
+        ev_io_modify(((ev_io *)self->watcher), code);
+        if (active) {
+            ev_io_start(loop, ((ev_io *)self->watcher));
+        }
+    }
+    return 0;
+}
+
+
+void
+__Watcher_invoke_callback__(Watcher *self, PyObject *arg)
+{
+    ev_loop *loop = self->loop->loop;
+    PyObject *result = NULL;
+
+    result = _Py_Invoke_Callback(self->callback, self, arg, NULL);
+    if (result && !__Watcher_apply_result__(self, result)) {
+        Py_DECREF(result);
+    }
+    else {
+        Py_XDECREF(result);
+        if (!ev_loop_defer(loop, (PyObject *)self, self->callback)) {
+            ev_loop_warn(loop, self->callback);
+        }
+    }
+}
+
+
+void
 __ev_watcher_invoke__(ev_loop *loop, ev_watcher *watcher, int revents)
 {
     Watcher *self = watcher->data;
-    PyObject *_revents_ = NULL, *_result_ = NULL;
+    PyObject *_revents_ = NULL;
 
     if (revents & EV_ERROR) {
         if (!PyErr_Occurred()) {
@@ -163,18 +291,14 @@ __ev_watcher_invoke__(ev_loop *loop, ev_watcher *watcher, int revents)
         // warn that we have been stopped
         __Watcher_warn__(self);
     }
-    else if (!_Py_Invoke_Verify(self->callback, "watcher callback")) {
+    else if (self->loop->collecting) {
+        // deferred, the loop will dispatch it from its queue
+        Loop_enqueue(self->loop, self, revents);
+    }
+    else if (!__Watcher_invoke_verify__(self)) {
         if (self->callback != Py_None) {
             if ((_revents_ = PyLong_FromLong(revents))) {
-                _result_ = _Py_Invoke_Callback(
-                    self->callback, self, _revents_, NULL
-                );
-                if (_result_) {
-                    Py_DECREF(_result_);
-                }
-                else {
-                    ev_loop_warn(loop, self->callback);
-                }
+                __Watcher_invoke_callback__(self, _revents_);
                 Py_DECREF(_revents_);
             }
         }
@@ -184,7 +308,10 @@ __ev_watcher_invoke__(ev_loop *loop, ev_watcher *watcher, int revents)
         }
 #endif
     }
-    if (PyErr_Occurred() || PyErr_CheckSignals()) {
+    if (
+        PyErr_Occurred() ||
+        (!self->loop->max_errors && PyErr_CheckSignals())
+    ) {
         ev_loop_stop(loop);
     }
 }
@@ -226,7 +353,13 @@ __ev_watcher_invoke__(ev_loop *loop, ev_watcher *watcher, int revents)
                 _Py_CHECK_CALLABLE_OR_NONE((cb), (r)); \
                 break; \
             default: \
-                _Py_CHECK_CALLABLE((cb), (r)); \
+                if (ev_cb(((W)->watcher)) != __ev_watcher_invoke__) { \
+                    /* native invoke, the callback is optional */ \
+                    _Py_CHECK_CALLABLE_OR_NONE((cb), (r)); \
+                } \
+                else { \
+                    _Py_CHECK_CALLABLE((cb), (r)); \
+                } \
                 break; \
         } \
     } while (0)
@@ -245,6 +378,8 @@ __Watcher_alloc__(PyTypeObject *type)
         self->loop = NULL;
         self->callback = NULL;
         self->data = NULL;
+        self->queued = 0;
+        self->deadline = 0.0;
     }
     return self;
 }
@@ -435,10 +570,45 @@ static PyObject *
 Watcher_stop(Watcher *self)
 {
     __ev_watcher_stop__(self->loop->loop, self->watcher, self->ev_type);
+    self->queued = 0;
+    Py_RETURN_NONE;
+}
+
+
+/* Watcher.start_threadsafe()/Watcher.stop_threadsafe() */
+static PyObject *
+__Watcher_post__(Watcher *self, _Py_Identifier *id)
+{
+    PyObject *name = NULL;
+
+    if (
+        !(name = _PyUnicode_FromId(id)) ||
+        Loop_post(self->loop, (PyObject *)self, name, NULL)
+    ) {
+        return NULL;
+    }
     Py_RETURN_NONE;
 }
 
 
+static PyObject *
+Watcher_start_threadsafe(Watcher *self)
+{
+    _Py_IDENTIFIER(start);
+
+    return __Watcher_post__(self, &PyId_start);
+}
+
+
+static PyObject *
+Watcher_stop_threadsafe(Watcher *self)
+{
+    _Py_IDENTIFIER(stop);
+
+    return __Watcher_post__(self, &PyId_stop);
+}
+
+
 /* Watcher.invoke(revents) */
 static PyObject *
 Watcher_invoke(Watcher *self, PyObject *args)
@@ -477,7 +647,11 @@ Watcher_feed(Watcher *self, PyObject *args)
 static PyObject *
 Watcher_clear(Watcher *self)
 {
-    return PyLong_FromLong(ev_clear_pending(self->loop->loop, self->watcher));
+    int revents = ev_clear_pending(self->loop->loop, self->watcher);
+
+    revents |= self->queued;
+    self->queued = 0;
+    return PyLong_FromLong(revents);
 }
 
 
@@ -495,6 +669,18 @@ static PyMethodDef Watcher_tp_methods[] = {
         METH_NOARGS,
         "stop()"
     },
+    {
+        "start_threadsafe",
+        (PyCFunction)Watcher_start_threadsafe,
+        METH_NOARGS,
+        "start_threadsafe()"
+    },
+    {
+        "stop_threadsafe",
+        (PyCFunction)Watcher_stop_threadsafe,
+        METH_NOARGS,
+        "stop_threadsafe()"
+    },
     {
         "invoke",
         (PyCFunction)Watcher_invoke,
@@ -582,6 +768,39 @@ Watcher_priority_setter(Watcher *self, PyObject *value, void *closure)
 }
 
 
+/* Watcher.deadline */
+static PyObject *
+Watcher_deadline_getter(Watcher *self, void *closure)
+{
+    if (!self->deadline) {
+        Py_RETURN_NONE;
+    }
+    return PyFloat_FromDouble(self->deadline);
+}
+
+static int
+Watcher_deadline_setter(Watcher *self, PyObject *value, void *closure)
+{
+    double deadline = 0.0;
+
+    _Py_PROTECTED_ATTRIBUTE(value, -1);
+    if (
+        (value != Py_None) &&
+        ((deadline = PyFloat_AsDouble(value)) == -1.0) &&
+        PyErr_Occurred()
+    ) {
+        return -1;
+    }
+    // NaN would make the ordering of the pending queue inconsistent
+    if (!isfinite(deadline)) {
+        PyErr_SetString(PyExc_ValueError, "deadline must be finite");
+        return -1;
+    }
+    self->deadline = deadline;
+    return 0;
+}
+
+
 /* Watcher.active */
 static PyObject *
 Watcher_active_getter(Watcher *self, void *closure)
@@ -594,7 +813,7 @@ Watcher_active_getter(Watcher *self, void *closure)
 static PyObject *
 Watcher_pending_getter(Watcher *self, void *closure)
 {
-    return PyBool_FromLong(ev_is_pending(self->watcher));
+    return PyBool_FromLong(ev_is_pending(self->watcher) || self->queued);
 }
 
 
@@ -628,6 +847,13 @@ static PyGetSetDef Watcher_tp_getsets[] = {
         NULL,
         NULL
     },
+    {
+        "deadline",
+        (getter)Watcher_deadline_getter,
+        (setter)Watcher_deadline_setter,
+        NULL,
+        NULL
+    },
     {
         "active",
         (getter)Watcher_active_getter,
@@ -661,3 +887,39 @@ PyTypeObject Watcher_Type = {
     .tp_init = (initproc)Watcher_tp_init,
     .tp_finalize = (destructor)Watcher_tp_finalize,
 };
+
+
+/* --------------------------------------------------------------------------
+   CallbackResult
+   -------------------------------------------------------------------------- */
+
+/* CallbackResult_Type.tp_repr */
+static PyObject *
+CallbackResult_tp_repr(CallbackResult *self)
+{
+    return PyUnicode_FromFormat("mood.event.%s", self->name);
+}
+
+
+/* CallbackResult_Type */
+PyTypeObject CallbackResult_Type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "mood.event.CallbackResult",
+    .tp_basicsize = sizeof(CallbackResult),
+    .tp_repr = (reprfunc)CallbackResult_tp_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION,
+};
+
+
+#define __CallbackResult_init__(c) \
+    {PyObject_HEAD_INIT(&CallbackResult_Type) #c, c}
+
+/* the only values the callback return value protocol acts on */
+CallbackResult CallbackResults[] = {
+    __CallbackResult_init__(EVCB_KEEP),
+    __CallbackResult_init__(EVCB_STOP),
+    __CallbackResult_init__(EVCB_READ),
+    __CallbackResult_init__(EVCB_WRITE),
+    __CallbackResult_init__(EVCB_READ_WRITE),
+    {PyObject_HEAD_INIT(NULL) NULL, 0}
+};
@@ -4,6 +4,10 @@
 
 #include "event.h"
 
+#include <openssl/ssl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -19,6 +23,8 @@ typedef struct {
     Loop *loop;
     PyObject *callback;
     PyObject *data;
+    int queued;
+    double deadline;
 } Watcher;
 
 
@@ -29,6 +35,12 @@ int __Watcher_traverse__(Watcher *, visitproc, void *);
 int __Watcher_clear__(Watcher *);
 void __Watcher_dealloc__(Watcher *);
 
+void __ev_watcher_start__(ev_loop *, ev_watcher *, int);
+void __ev_watcher_stop__(ev_loop *, ev_watcher *, int);
+void __ev_watcher_invoke__(ev_loop *, ev_watcher *, int);
+int __Watcher_invoke_verify__(Watcher *);
+void __Watcher_invoke_callback__(Watcher *, PyObject *);
+
 
 int Watcher_check_active(Watcher *, const char *);
 int Watcher_check_set(Watcher *);
@@ -37,6 +49,22 @@ PyObject *Watcher_new(PyTypeObject *, int , size_t);
 int Watcher_init(Watcher *, Loop *, PyObject *, PyObject *, int);
 
 
+/* pending queue (loop.c) */
+int Loop_enqueue(Loop *, Watcher *, int);
+
+/* native watchers (loop.c) */
+int Loop_add_native(Loop *, ev_watcher *);
+void Loop_remove_native(Loop *, ev_watcher *);
+
+
+/* -------------------------------------------------------------------------- */
+
+int __Io_set__(Watcher *, PyObject *, int);
+
+PyObject *__Io_address__(const struct sockaddr *, size_t);
+int __Io_sockaddr__(int, PyObject *, struct sockaddr_storage *, socklen_t *);
+
+
 /* -------------------------------------------------------------------------- */
 
 #if EV_PERIODIC_ENABLE
@@ -64,6 +92,256 @@ typedef struct {
 #endif
 
 
+/* -------------------------------------------------------------------------- */
+
+#if EV_ASYNC_ENABLE
+typedef struct {
+    Watcher watcher;
+    Mailbox mailbox;
+} AsyncQueue;
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+// see MoodEvent_NativeHandler in capi.h
+typedef int (*NativeHandler)(int, int, int, Py_ssize_t *);
+
+typedef struct {
+    Watcher watcher;
+    PyObject *handler;
+    NativeHandler func;
+    int target;
+    unsigned long long count;
+    unsigned long long bytes;
+    int error;
+} NativeIo;
+
+typedef struct {
+    NativeIo native;
+    off_t offset;
+    Py_ssize_t remaining;
+} FileSender;
+
+typedef struct {
+    int src;
+    int dst;
+    int pipe[2];
+    Py_ssize_t pending;
+    int eof;
+    unsigned long long bytes;
+} SpliceFlow;
+
+typedef struct {
+    NativeIo native;
+    ev_io *peer;
+    SpliceFlow flows[2];
+} Splice;
+
+
+/* -------------------------------------------------------------------------- */
+
+enum {
+    STREAM_DELIMITER = 1,
+    STREAM_PREFIX,
+    STREAM_FIXED
+};
+
+typedef struct __StreamChunk__ {
+    struct __StreamChunk__ *next;
+    char *data;
+} StreamChunk;
+
+typedef struct {
+    Py_ssize_t views;
+    int done;
+} StreamCompletion;
+
+struct __Stream__;
+
+// how a stream moves bytes to and from fd (read(2)/writev(2) semantics)
+typedef struct {
+    ssize_t (*recv)(struct __Stream__ *, char *, size_t);
+    ssize_t (*send)(struct __Stream__ *, struct iovec *, int, int *);
+    // optional, returns 1 if fd must be watched for EV_WRITE, -1 on error
+    int (*flush)(struct __Stream__ *);
+    // optional, returns 1 if input was pulled from fd but not returned yet
+    int (*buffered)(struct __Stream__ *);
+    // optional, called at the end of the stream if there was no error
+    void (*shutdown)(struct __Stream__ *);
+} StreamOps;
+
+typedef struct __Stream__ {
+    Watcher watcher;
+    const StreamOps *ops;
+    PyObject *framer;
+    int kind;
+    int prefix;
+    int little;
+    Py_ssize_t fixed;
+    Py_ssize_t scanned;
+    char *data;
+    Py_ssize_t start;
+    Py_ssize_t end;
+    Py_ssize_t size;
+    Py_ssize_t budget;
+    Py_ssize_t max_size;
+    char *frame;
+    Py_ssize_t frame_len;
+    Py_ssize_t exports;
+    StreamChunk *retired;
+    int error;
+    ev_prepare *prepare;
+    Py_buffer *writes;
+    Py_ssize_t writes_sent;
+    Py_ssize_t writes_head;
+    Py_ssize_t writes_len;
+    Py_ssize_t writes_size;
+    Py_ssize_t offset;
+    Py_ssize_t buffered;
+    Py_ssize_t high;
+    Py_ssize_t low;
+    int paused;
+    PyObject *backpressure;
+    Py_ssize_t zerocopy;
+    StreamCompletion *completions;
+    Py_ssize_t completions_head;
+    Py_ssize_t completions_len;
+    Py_ssize_t completions_size;
+    uint32_t zckey;
+} Stream;
+
+
+Stream *__Stream_alloc__(PyTypeObject *);
+int __Stream_post_alloc__(Stream *, int, size_t);
+void __Stream_finalize__(Stream *);
+int __Stream_traverse__(Stream *, visitproc, void *);
+int __Stream_clear__(Stream *);
+void __Stream_dealloc__(Stream *);
+
+int __Stream_set_framer__(Stream *, PyObject *);
+
+
+typedef struct {
+    PyObject_HEAD
+    PyObject *subscribers;
+    Py_ssize_t limit;
+    int disconnect;
+    unsigned long long dropped;
+} Broadcast;
+
+typedef struct {
+    PyObject_HEAD
+    SSL_CTX *ctx;
+    int server_side;
+} TLSContext;
+
+typedef struct {
+    Stream stream;
+    PyObject *context;
+    SSL *ssl;
+    BIO *network;
+    int ktls;
+    int want;
+} TLSStream;
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    Watcher watcher;
+    ev_timer *retry;
+    double backoff;
+    int batch;
+    int nodelay;
+    int rcvbuf;
+    int sndbuf;
+    int error;
+} Listener;
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    int family;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+} ConnectorAddress;
+
+typedef struct {
+    Watcher watcher;
+    ConnectorAddress *addresses;
+    ev_io *ios;
+    Py_ssize_t count;
+    Py_ssize_t next;
+    double timeout;
+    double delay;
+    ev_tstamp expiry;
+    int stagger;
+    int done;
+    int fd;
+    int error;
+} Connector;
+
+
+/* -------------------------------------------------------------------------- */
+
+#if EV_ASYNC_ENABLE
+typedef struct {
+    ev_io io;
+    PyObject *data;
+    int revents;
+} IoMuxEntry;
+
+typedef struct {
+    Watcher watcher;
+    IoMuxEntry **pages;
+    Py_ssize_t npages;
+    Py_ssize_t count;
+    int *ready;
+    Py_ssize_t ready_len;
+    Py_ssize_t ready_size;
+    int batch;
+} IoMux;
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+typedef struct {
+    Py_buffer view;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+} DatagramMessage;
+
+typedef struct {
+    Watcher watcher;
+    int family;
+    int batch;
+    int size;
+    int gro;
+    int segment;
+    int resize;
+    char *slab;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    struct sockaddr_storage *addrs;
+    char *controls;
+    char *frame;
+    Py_ssize_t frame_len;
+    Py_ssize_t exports;
+    StreamChunk *retired;
+    ev_prepare *prepare;
+    DatagramMessage *sends;
+    Py_ssize_t sends_head;
+    Py_ssize_t sends_len;
+    Py_ssize_t sends_size;
+    Py_ssize_t buffered;
+    Py_ssize_t truncated;
+    int error;
+} Datagram;
+
+
 /* -------------------------------------------------------------------------- */
 
 #ifdef __cplusplus